@@ -5,9 +5,51 @@
 #include <list>
 #include <utility>
 #include <exception>
+#include <stdexcept>
 #include <vector>
 #include <random>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
+#include <limits>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#ifdef HAVE_MPI
+#define OMPI_SKIP_MPICXX 1  // the C API only, without the deprecated C++ bindings
+#define MPICH_SKIP_MPICXX 1
+#include <mpi.h>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_X86_MICROKERNELS 1
+#endif
+
+#include "common.hpp"
 
 using namespace std;
 
@@ -17,16 +59,382 @@ struct Result
 	int threads;
 };
 
+// bfloat16: the top half of an IEEE binary32, so widening is a shift and
+// narrowing rounds the dropped 16 bits to nearest even
+struct bfloat16
+{
+	uint16_t bits;
+
+	bfloat16() = default;
+	bfloat16(float value)
+	{
+		uint32_t word;
+		memcpy(&word, &value, sizeof(word));
+		if ((word & 0x7fffffffu) > 0x7f800000u) bits = static_cast<uint16_t>((word >> 16) | 0x40);  // quiet NaN
+		else bits = static_cast<uint16_t>((word + 0x7fffu + ((word >> 16) & 1)) >> 16);
+	}
+	operator float() const
+	{
+		const uint32_t word = static_cast<uint32_t>(bits) << 16;
+		float value;
+		memcpy(&value, &word, sizeof(value));
+		return value;
+	}
+};
+
+// Dense row-major matrix stored in one contiguous, cache-line aligned block.
+// Rows are padded to a whole number of cache lines (ld >= cols), so every row
+// starts on a 64-byte boundary and element (i, j) lives at data[i * ld + j].
+// The constructor does not touch the memory: fill() and initializeMatrix()
+// write it from a thread team, so each page lands on the NUMA node of the
+// thread that owns those rows in a statically scheduled kernel. A matrix can
+// instead live in a named POSIX shared memory object (server mode), which
+// other processes map to read and write it in place. T is the element type
+// (see --precision); shared memory and matrix files hold doubles only.
+template <typename T>
+struct BasicMatrix
+{
+	static const int alignment = 64;
+
+	int rows, cols, ld;
+	T* data;
+	size_t mappedBytes = 0;   // size of the mapping when data is mmap()ed, 0 for the heap
+	size_t mappedOffset = 0;  // bytes from the start of the mapping to data (a file's header)
+	string sharedName;        // shared memory object behind data, unlinked with the matrix
+
+	BasicMatrix(int rows, int cols);
+	BasicMatrix(int rows, int cols, const string& sharedName);
+	BasicMatrix(BasicMatrix&& other);
+	~BasicMatrix();
+
+	// Matrix files (see MatrixFileHeader): load maps an existing file
+	// copy-on-write, create makes a new zero-filled one that is written through
+	static BasicMatrix load(const char* path);
+	static BasicMatrix create(const char* path, int rows, int cols);
+
+	T* row(int i) { return data + static_cast<size_t>(i) * ld; }
+	const T* row(int i) const { return data + static_cast<size_t>(i) * ld; }
+	T& operator()(int i, int j) { return row(i)[j]; }
+	T operator()(int i, int j) const { return row(i)[j]; }
+	void fill(double value, int nThreads = omp_get_max_threads());
+
+	BasicMatrix(const BasicMatrix&) = delete;
+	BasicMatrix& operator=(const BasicMatrix&) = delete;
+
+private:
+	BasicMatrix() : rows(0), cols(0), ld(0), data(nullptr) {}
+};
+
+typedef BasicMatrix<double> Matrix;
+
+template <> Matrix::BasicMatrix(int rows, int cols, const string& sharedName);
+template <> Matrix Matrix::load(const char* path);
+template <> Matrix Matrix::create(const char* path, int rows, int cols);
+
+// Element and accumulation types selected with --precision
+enum Precision { fp64, fp32, fp32Accumulate64, bf16Accumulate32 };
+
+// Header of the binary matrix files read by --load-* and written by --store-*.
+// Element (i, j) is the double at byte dataOffset + (i * ld + j) * 8, so a
+// file maps straight into a Matrix: kernels read it in place and the only
+// start-up cost is the page faults of the rows they touch.
+struct MatrixFileHeader
+{
+	char magic[8];        // "BMMATRIX"
+	uint32_t byteOrder;   // 0x01020304 as stored by the writer; files are only read on the same byte order
+	uint32_t dtype;       // 1 = IEEE 754 binary64
+	uint64_t rows, cols;
+	uint64_t ld;          // elements from one row to the next, at least cols
+	uint64_t alignment;   // bytes; dataOffset and the row stride are multiples of it
+	uint64_t dataOffset;  // bytes from the start of the file to element (0, 0)
+	uint64_t reserved;
+};
+
+static_assert(sizeof(MatrixFileHeader) % Matrix::alignment == 0, "matrix file rows must stay aligned");
+
+static const char matrixFileMagic[8] = { 'B', 'M', 'M', 'A', 'T', 'R', 'I', 'X' };
+static const uint32_t matrixFileByteOrder = 0x01020304, matrixFileDouble = 1;
+
+// Cache blocking for the packed kernel, using the BLIS/GotoBLAS names: an
+// MC x KC panel of A is packed to stay in L2, a KC x NC panel of B in L3.
+struct PackedParams
+{
+	int mc, kc, nc;
+};
+
+// Problem shape: C (m x n) += op(A) (m x k) * op(B) (k x n). A transposed
+// operand is stored the other way round (A as k x m, B as n x k) and read in
+// place through swapped strides, never copied into a transpose.
+struct Shape
+{
+	int m, n, k;
+	bool transposeA, transposeB;
+};
+
+// Element strides of op(X) for an operand stored row-major with leading
+// dimension ld: op(X)(i, j) = x[i * row + j * col]
+struct Strides
+{
+	size_t row, col;
+
+	static Strides of(int ld, bool transposed)
+	{
+		return transposed ? Strides{ 1, static_cast<size_t>(ld) } : Strides{ static_cast<size_t>(ld), 1 };
+	}
+};
+
+// Compressed sparse row copy of op(A): the nonzeros of row i are
+// values[rowStart[i] .. rowStart[i + 1]), in column order, at column[...]
+struct CsrMatrix
+{
+	int rows, cols;
+	vector<size_t> rowStart;
+	vector<int> column;
+	vector<double> values;
+
+	static CsrMatrix fromDense(const Matrix& a, const Shape& shape, int nThreads);
+	size_t nonzeros() const { return values.size(); }
+};
+
+// Register-blocked inner kernel: C[0:mr, 0:nr] += A_panel * B_panel, where
+// A_panel is kc columns of mr packed values and B_panel kc rows of nr.
+template <typename T>
+struct MicroKernelOf
+{
+	static const int maxMR = 8, maxNR = 128 / sizeof(T);  // up to two 64-byte vectors per row
+
+	const char* name;
+	int mr, nr;
+	void (*compute)(int kc, const T* a, const T* b, T* c, int ldc);
+};
+
+typedef MicroKernelOf<double> MicroKernel;
+
+uint64_t randomSeed();
+
+// Grow-only scratch space that is reused across calls instead of being
+// allocated for every multiply
+struct ScratchBuffer
+{
+	double* data = nullptr;
+	size_t capacity = 0;
+
+	double* reserve(size_t count);
+	~ScratchBuffer();
+
+	// The same space as count elements of another type
+	template <typename T> T* reserveAs(size_t count)
+	{
+		return reinterpret_cast<T*>(reserve((count * sizeof(T) + sizeof(double) - 1) / sizeof(double)));
+	}
+};
+
+// Loop schedule handed to schedule(runtime) loops; chunk 0 keeps the default
+struct Schedule
+{
+	omp_sched_t kind;
+	int chunk;
+};
+
+// Optional settings given after the positional batch arguments
+struct Options
+{
+	PackedParams packed = { 144, 256, 4096 };
+	const char* kernel = "auto";  // micro-kernel name, or "auto" to pick by CPU
+	Schedule schedule = { omp_sched_static, 0 };
+	bool autotune = false;  // take NEIB/threads/schedule from the tuning file, searching on a miss
+	bool retune = false;    // search even when the tuning file already has an entry
+	const char* tuningFile = "blocked-matrix-multiplication.tuning";
+	uint64_t seed = randomSeed();  // fixed with --seed for reproducible operands
+	const char* numa = nullptr;    // thread binding for NUMA mode: "close" or "spread"
+	int cutoff = 256;              // Strassen: switch to the packed kernel at or below this size
+	int taskDepth = 0;             // Strassen: recursion levels run as tasks, 0 = enough for all threads
+	int warmup = 1;                // benchmark mode: untimed runs before measuring
+	int reps = 0;                  // benchmark mode: measured runs, 0 = single run with the plain CSV line
+	const char* format = "csv";    // benchmark report format: csv or json
+	const char* verify = nullptr;  // check C against A * B: "auto", "full" or "freivalds"
+	double tolerance = 16.0;       // verification bound in units of N * epsilon * (|A| |B|)(i, j)
+	const char* load[2] = {};      // matrix files mapped as A and B instead of the random fill
+	const char* store[3] = {};     // matrix files that A, B and C are created in
+	int tileMemory = 1024;         // out-of-core: MiB for cached A/B tiles and the two C tiles
+	Precision precision = fp64;    // element type of A and B, and of the accumulation and C
+	Shape shape = { 0, 0, 0, false, false };  // --shape=MxKxN and --transpose-a/b; zero sizes take N
+	double density = 1.0;          // fraction of A's elements the seeded fill leaves nonzero
+	double sparseThreshold = 0.1;  // method 8: largest density of op(A) multiplied in CSR form
+	bool counters = false;         // benchmark mode: perf_event counters around each measured run
+	const char* trace = nullptr;   // batch mode: Chrome trace file of the kernels' parallel regions
+	int device = -1;               // OpenMP device that method 5 is offloaded to, -1 = the host kernels
+	int grid[2] = {};              // method 9: process grid rows x columns, zero = chosen by MPI_Dims_create
+	int panel = 256;               // method 9: width of the k panels broadcast along the grid
+};
+
+// What the out-of-core multiply moved and how long the kernels waited for it
+struct OutOfCoreStats
+{
+	double readBytes = 0, writtenBytes = 0;
+	double ioWait = 0;            // seconds the compute thread was blocked on the I/O thread
+	long long hits = 0, misses = 0;  // tile requests already cached (or in flight) / read on demand
+	int cachedTiles = 0;
+};
+
+// What the distributed multiply broadcast and how long the ranks waited for it
+struct SummaStats
+{
+	double broadcastBytes = 0;  // panel bytes this rank received or sent
+	double commWait = 0;        // seconds blocked on a panel broadcast that the kernel did not hide
+};
+
+#ifdef HAVE_MPI
+// P x Q ranks of MPI_COMM_WORLD, row-major. Rank (row, col) owns block
+// (row, col) of C, the same block row of A and block column of B, each cut
+// into near-equal contiguous slices (see partStart).
+struct ProcessGrid
+{
+	int rows, cols;
+	int row, col;               // this rank's position
+	MPI_Comm rowComm, colComm;  // ranks of this grid row, by column, and of this grid column, by row
+};
+#endif
+
+// Outcome of checking a product: the largest error seen, as a fraction of the
+// bound allowed for that element, so the check passes while worst <= 1
+struct Verification
+{
+	const char* check;  // "full" or "freivalds"
+	double worst;
+};
+
+// NUMA layout of the host: node of every logical CPU (Linux sysfs; other
+// systems are treated as a single node)
+struct Topology
+{
+	int nodes;
+	vector<int> cpuNode;
+};
+
+// Best blocked-kernel configuration found for one CPU model, method and N range
+struct Tuning
+{
+	int neib, threads;
+	Schedule schedule;
+};
+
+// A, B and C mapped to an OpenMP device for a whole batch (target enter
+// data), so repeated runs of the offloaded kernel find them present and move
+// no operands; fetch copies C back, and the copies go with the object
+template <typename In, typename Out>
+struct DeviceOperands
+{
+	DeviceOperands(const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c, int device);
+	~DeviceOperands();
+	void fetch();
+
+	const In* a;
+	const In* b;
+	Out* c;
+	size_t sizeA, sizeB, sizeC;
+	int device;
+};
+
+// NUMA mode's setup for one batch, made before any timed run: the node each
+// thread of the team is pinned to, the tile rows of C that first touch put on
+// each node, and a replica of B per node written by that node's threads
+template <typename T>
+struct NumaOperands
+{
+	NumaOperands(const BasicMatrix<T>& b, int N, int NEIB, int nThreads);
+
+	int nodes, NEIB, nThreads;
+	vector<int> threadNode;
+	vector<vector<int>> nodeRows;
+	vector<BasicMatrix<T>> replicas;  // empty on a single node, where B is read in place
+};
+
 // Function declarations
-void initializeMatrix(vector<vector<double>>& matrix, int size, bool random = true);
-void printMatrix(const vector<vector<double>>& matrix, int size, int maxDisplay = 5);
-bool verifyResult(const vector<vector<double>>& c1, const vector<vector<double>>& c2, int size);
-const Result blockedMatrixMultiplication(vector<vector<double>>& a, vector<vector<double>>& b, 
-                                        vector<vector<double>>& c, int N, int NEIB, int nThreads);
-const Result standardMatrixMultiplication(vector<vector<double>>& a, vector<vector<double>>& b, 
-                                         vector<vector<double>>& c, int N, int nThreads);
-const Result sequentialMatrixMultiplication(vector<vector<double>>& a, vector<vector<double>>& b, 
-                                           vector<vector<double>>& c, int N);
+template <typename T = double> T* allocateAligned(size_t count);
+Matrix operandMatrix(const char* load, const char* store, int rows, int cols);
+const char* matrixFileProblem(const MatrixFileHeader& header, uint64_t bytes);
+MatrixFileHeader matrixFileHeader(int rows, int cols);
+bool parseOption(const char* arg, Options& options);
+bool parseSchedule(const char* text, Schedule& schedule);
+const char* scheduleName(const Schedule& schedule);
+template <typename T = double> const MicroKernelOf<T>& selectMicroKernel(const char* name);
+const char* precisionName(Precision precision);
+bool parseDevice(const char* text, int& device);
+string deviceName(int device);
+Shape problemShape(int N, const Options& options);
+Shape squareShape(int N);
+bool isSquare(const Shape& shape);
+const char* transposeName(const Shape& shape);
+void addCounterFields(vector<ReportField>& report, const KernelCounters& counters, int runs, double flops);
+bool bindThreads(char* argv[], const char* binding);
+const Topology& topology();
+int currentNode();
+void reportTopology(ostream& out, int nThreads);
+const Tuning findTuning(short method, const Matrix& a, const Matrix& b, Matrix& c, int N, const Options& options);
+const Result runMethod(short method, const Matrix& a, const Matrix& b, Matrix& c, const Shape& shape, int NEIB,
+                       int nThreads, const Options& options, const NumaOperands<double>* numa = nullptr);
+template <typename In, typename Out>
+const Result runMethod(short method, const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                       const Shape& shape, int NEIB, int nThreads, const Options& options,
+                       const NumaOperands<In>* numa = nullptr);
+template <typename In, typename Out>
+int runBatch(short method, const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+             const Shape& shape, int NEIB, int nThreads, const Options& options);
+template <typename In, typename Out>
+int runReducedPrecision(short method, const Shape& shape, int NEIB, int nThreads, const Options& options);
+template <typename T>
+void initializeMatrix(BasicMatrix<T>& matrix, uint64_t seed, int nThreads, bool transposed = false,
+                      double density = 1.0, bool random = true);
+void initializeSlice(Matrix& matrix, uint64_t seed, int nThreads, int cols, int row0, int col0, double density = 1.0);
+void printMatrix(const Matrix& matrix, int size, int maxDisplay = 5);
+template <typename In, typename Out>
+const Verification verifyResult(const BasicMatrix<In>& a, const BasicMatrix<In>& b, const BasicMatrix<Out>& c,
+                                const Shape& shape, const Options& options, int nThreads);
+bool reportVerification(const Verification& verification, short method, double tolerance);
+int serve(const char* path, const Options& options);
+template <typename In, typename Out>
+const Result blockedMatrixMultiplication(const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                                         const Shape& shape, int NEIB, int nThreads);
+template <typename In, typename Out>
+const Result collapsedBlockedMatrixMultiplication(const BasicMatrix<In>& a, const BasicMatrix<In>& b,
+                                                  BasicMatrix<Out>& c, const Shape& shape, int NEIB, int nThreads,
+                                                  const Schedule& schedule);
+const Result numaBlockedMatrixMultiplication(const Matrix& a, const Matrix& b, Matrix& c, int N, int NEIB,
+                                             int nThreads, const NumaOperands<double>& numa);
+const Result offloadedBlockedMatrixMultiplication(const Matrix& a, const Matrix& b, Matrix& c, const Shape& shape,
+                                                  int NEIB, int nThreads, int device);
+template <typename In, typename Out>
+const Result standardMatrixMultiplication(const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                                          const Shape& shape, int nThreads);
+template <typename In, typename Out>
+const Result sequentialMatrixMultiplication(const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                                            const Shape& shape);
+template <typename In, typename Out>
+const Result packedMatrixMultiplication(const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                                        const Shape& shape, int nThreads, const PackedParams& params,
+                                        const MicroKernelOf<Out>& kernel);
+template <typename In, typename Out>
+void gemmPacked(int m, int n, int k, const In* a, int lda, const In* b, int ldb, Out* c, int ldc,
+                const PackedParams& params, const MicroKernelOf<Out>& kernel, int nThreads, bool transposeA = false,
+                bool transposeB = false);
+const Result strassenMatrixMultiplication(const Matrix& a, const Matrix& b, Matrix& c, int N, int nThreads,
+                                          int cutoff, int taskDepth, const PackedParams& params,
+                                          const MicroKernel& kernel);
+const Result outOfCoreMatrixMultiplication(const char* aPath, const char* bPath, const char* cPath, int N, int tile,
+                                           int nThreads, const Options& options, OutOfCoreStats& stats);
+int runOutOfCore(int N, int tile, int nThreads, const Options& options);
+int partStart(int extent, int parts, int index);
+#ifdef HAVE_MPI
+const Result summaMatrixMultiplication(const Matrix& a, const Matrix& b, Matrix& c, const Shape& shape,
+                                       const ProcessGrid& grid, int NEIB, int panel, int nThreads, SummaStats& stats);
+#endif
+int runDistributed(const Shape& shape, int NEIB, int nThreads, const Options& options);
+size_t countNonzeros(const Matrix& a, const Shape& shape, int nThreads);
+const Result sparseMatrixMultiplication(const CsrMatrix& a, const Matrix& b, Matrix& c, const Shape& shape,
+                                        int nThreads);
+const Result sparseOrDenseMatrixMultiplication(const Matrix& a, const Matrix& b, Matrix& c, const Shape& shape,
+                                               int nThreads, const Options& options);
 
 int main(int argc, char* argv[])
 {
@@ -35,14 +443,44 @@ int main(int argc, char* argv[])
 	short method;
 	bool batchMode = false;
 	int specificThreads = 0;
+	Options options;
+
+	// Server mode: --serve=<socket path> [--option=value ...]
+	if (argc >= 2 && strncmp(argv[1], "--serve=", 8) == 0)
+	{
+		for (int i = 2; i < argc; i++)
+		{
+			if (!parseOption(argv[i], options))
+			{
+				cout << "Error: invalid option " << argv[i] << endl;
+				return 1;
+			}
+		}
+		return serve(argv[1] + 8, options);
+	}
 
-	// Check for command line arguments
-	if (argc == 5) {
+	// Check for command line arguments: N NEIB method threads [--option=value ...]
+	if (argc >= 5) {
 		N = atoi(argv[1]);
 		NEIB = atoi(argv[2]);
 		method = atoi(argv[3]);
 		specificThreads = atoi(argv[4]);
 		batchMode = true;
+
+		for (int i = 5; i < argc; i++)
+		{
+			if (!parseOption(argv[i], options))
+			{
+				cout << "Error: invalid option " << argv[i] << endl;
+				return 1;
+			}
+		}
+
+		if (options.numa && !bindThreads(argv, options.numa))
+		{
+			cout << "Error: --numa must be close or spread" << endl;
+			return 1;
+		}
 	}
 
 	cout << fixed << setprecision(8) << endl;
@@ -53,12 +491,12 @@ int main(int argc, char* argv[])
 			{
 				cout << "   Matrix size (N): "; cin >> N;
 				cout << "   Block size (NEIB): "; cin >> NEIB;
-				cout << "   Method (1 - blocked, 2 - standard, 3 - sequential): "; cin >> method;
+				cout << "   Method (1 - blocked, 2 - standard, 3 - sequential, 4 - packed, 5 - blocked collapsed, 6 - strassen, 8 - sparse): "; cin >> method;
 
-				// Validate block size (only for blocked method)
-				if (method == 1 && N % NEIB != 0)
+				// Validate block size (only for blocked methods)
+				if ((method == 1 || method == 5) && NEIB <= 0)
 				{
-					cout << "   Error: Matrix size must be divisible by block size for blocked method!" << endl;
+					cout << "   Error: Block size must be positive for blocked methods!" << endl;
 					continue;
 				}
 			}
@@ -66,25 +504,82 @@ int main(int argc, char* argv[])
 
 		// Common execution logic for both interactive and batch mode
 		do {
-			// Validate block size (only for blocked method)
-			if (method == 1 && N % NEIB != 0)
+			// Validate block size (only for blocked methods)
+			if ((method == 1 || method == 5 || method == 9) && NEIB <= 0)
 			{
 				if (batchMode) {
-					cout << "Error: Matrix size must be divisible by block size for blocked method!" << endl;
+					cout << "Error: Block size must be positive for blocked methods!" << endl;
 					return 1;
 				} else {
-					cout << "   Error: Matrix size must be divisible by block size for blocked method!" << endl;
+					cout << "   Error: Block size must be positive for blocked methods!" << endl;
 					continue;
 				}
 			}
 
-			// Initialize matrices
-			vector<vector<double>> a(N, vector<double>(N));
-			vector<vector<double>> b(N, vector<double>(N));
-			vector<vector<double>> c(N, vector<double>(N, 0.0));
+			const Shape shape = problemShape(N, options);
+
+			// Distributed SUMMA: every rank of mpirun builds and multiplies its own blocks
+			if (method == 9)
+			{
+				if (!batchMode || specificThreads <= 0)
+					throw invalid_argument("The distributed method needs batch mode with a thread count per rank");
+				if (options.numa || options.autotune || options.device >= 0 || options.precision != fp64 ||
+				    options.counters || options.trace || options.load[0] || options.load[1] || options.store[0] ||
+				    options.store[1] || options.store[2] || shape.transposeA || shape.transposeB)
+					throw invalid_argument("The distributed method multiplies seeded, untransposed fp64 operands, "
+					                       "without --numa, --autotune, --device, --counters, --trace or matrix files");
+				return runDistributed(shape, NEIB, specificThreads, options);
+			}
+
+			// Offload: method 5 only, and the host kernels when the device does not exist
+			if (options.device >= 0)
+			{
+				if (method != 5 || options.numa || options.autotune || options.precision != fp64 || !batchMode ||
+				    specificThreads <= 0)
+					throw invalid_argument("--device offloads fp64 method 5 in batch mode, without --numa or --autotune");
+				if (options.device >= omp_get_num_devices())
+				{
+					cerr << "Warning: no OpenMP device " << options.device << " (" << omp_get_num_devices()
+					     << " available), method 5 runs on the host" << endl;
+					options.device = -1;
+				}
+			}
+
+			// Out-of-core: the operands stay in their files, NEIB is the tile edge
+			if (method == 7)
+			{
+				if (NEIB <= 0) throw invalid_argument("Tile size must be positive for the out-of-core method");
+				if (!isSquare(shape)) throw invalid_argument("The out-of-core method needs a square, untransposed product");
+				return runOutOfCore(N, NEIB, specificThreads > 0 ? specificThreads : omp_get_max_threads(), options);
+			}
+
+			// Reduced precisions run on typed operands of their own; fp64 goes on below
+			if (options.precision != fp64)
+			{
+				if (!batchMode || specificThreads <= 0)
+					throw invalid_argument("--precision needs batch mode with a thread count");
+				switch (options.precision)
+				{
+				case fp32: return runReducedPrecision<float, float>(method, shape, NEIB, specificThreads, options);
+				case fp32Accumulate64:
+					return runReducedPrecision<float, double>(method, shape, NEIB, specificThreads, options);
+				default: return runReducedPrecision<bfloat16, float>(method, shape, NEIB, specificThreads, options);
+				}
+			}
+
+			// Initialize matrices: A is m x k and B k x n, each stored the other way round when transposed
+			Matrix a = shape.transposeA ? operandMatrix(options.load[0], options.store[0], shape.k, shape.m) :
+			                              operandMatrix(options.load[0], options.store[0], shape.m, shape.k);
+			Matrix b = shape.transposeB ? operandMatrix(options.load[1], options.store[1], shape.n, shape.k) :
+			                              operandMatrix(options.load[1], options.store[1], shape.k, shape.n);
+			Matrix c = operandMatrix(nullptr, options.store[2], shape.m, shape.n);
 
-			initializeMatrix(a, N);
-			initializeMatrix(b, N);
+			// Fill with the team that will run the kernel so first touch places each
+			// row block with its thread; A and B use independent streams of the seed
+			const int initThreads = specificThreads > 0 ? specificThreads : omp_get_max_threads();
+			if (!options.load[0]) initializeMatrix(a, options.seed, initThreads, shape.transposeA, options.density);
+			if (!options.load[1]) initializeMatrix(b, options.seed + 1, initThreads, shape.transposeB);
+			c.fill(0.0, initThreads);
 
 			if (!batchMode) {
 				cout << endl << "   Sample of matrix A (top-left corner):" << endl;
@@ -93,28 +588,31 @@ int main(int argc, char* argv[])
 				printMatrix(b, N);
 			}
 
+			if (options.numa) reportTopology(cerr, initThreads);
+
+			if (options.autotune)
+			{
+				if (!isSquare(shape)) throw invalid_argument("--autotune tunes square, untransposed products only");
+				const Tuning tuning = findTuning(method, a, b, c, N, options);
+				NEIB = tuning.neib;
+				specificThreads = tuning.threads;
+				options.schedule = tuning.schedule;
+			}
+
 			list<pair<short, Result>> results;
 			double sequentialTime = 0.0;
 			
+			if (method == 8)
+			{
+				const double density = static_cast<double>(countNonzeros(a, shape, initThreads)) / shape.m / shape.k;
+				cerr << "Sparse: op(A) density " << setprecision(4) << density << ", threshold "
+				     << options.sparseThreshold << ", " << (density <= options.sparseThreshold ? "CSR" : "packed dense")
+				     << " path" << endl;
+			}
+
 			if (batchMode && specificThreads > 0) {
 				// Batch mode: run with specific thread count
-				// Reset result matrix
-				for (int row = 0; row < N; row++)
-					for (int col = 0; col < N; col++)
-						c[row][col] = 0.0;
-
-				Result result;
-				if (method == 3) {
-					result = sequentialMatrixMultiplication(a, b, c, N);
-				} else if (method == 1) {
-					result = blockedMatrixMultiplication(a, b, c, N, NEIB, specificThreads);
-				} else {
-					result = standardMatrixMultiplication(a, b, c, N, specificThreads);
-				}
-				
-				// Output in CSV format for Python parsing
-				cout << method << "," << specificThreads << "," << fixed << setprecision(8) << result.timestamp << endl;
-				return 0;
+				return runBatch(method, a, b, c, shape, NEIB, specificThreads, options);
 			}
 			else {
 				// Interactive mode: run full analysis
@@ -122,11 +620,9 @@ int main(int argc, char* argv[])
 				if (method == 3)
 				{
 					// Reset result matrix
-					for (int row = 0; row < N; row++)
-						for (int col = 0; col < N; col++)
-							c[row][col] = 0.0;
+					c.fill(0.0);
 
-					Result result = sequentialMatrixMultiplication(a, b, c, N);
+					Result result = sequentialMatrixMultiplication(a, b, c, shape);
 					sequentialTime = result.timestamp;
 					pair<short, Result> s_result(1, result);
 					results.push_back(s_result);
@@ -137,13 +633,9 @@ int main(int argc, char* argv[])
 					for (int i = 0; i < maxThreads; i++)
 					{
 						// Reset result matrix
-						for (int row = 0; row < N; row++)
-							for (int col = 0; col < N; col++)
-								c[row][col] = 0.0;
+						c.fill(0.0);
 
-						Result result = (method == 1) ?
-							blockedMatrixMultiplication(a, b, c, N, NEIB, i + 1) :
-							standardMatrixMultiplication(a, b, c, N, i + 1);
+						Result result = runMethod(method, a, b, c, shape, NEIB, i + 1, options);
 
 						// Store sequential baseline (1 thread) for speedup calculation
 						if (i == 0) sequentialTime = result.timestamp;
@@ -181,108 +673,2778 @@ int main(int argc, char* argv[])
 	catch (exception & e)
 	{
 		cout << e.what() << endl;
+		if (batchMode) return 1;
 	}
 	if (!batchMode) cin.get();
 	return 0;
 }
 
-const Result blockedMatrixMultiplication(vector<vector<double>>& a, vector<vector<double>>& b, 
-                                        vector<vector<double>>& c, int N, int NEIB, int nThreads)
+bool parseOption(const char* arg, Options& options)
 {
-	const int NB = N / NEIB;  // Number of blocks per dimension
-	double now = omp_get_wtime();
-	
-	int p, q, r, i, j, k;
-	
-	for (p = 0; p < NB; p++) {
-		#pragma omp parallel for default(shared) private(q, r, i, j, k) num_threads(nThreads)
-		for (q = 0; q < NB; q++)
-			for (r = 0; r < NB; r++)
-				for (i = p * NEIB; i < p * NEIB + NEIB; i++)
-					for (j = q * NEIB; j < q * NEIB + NEIB; j++)
-						for (k = r * NEIB; k < r * NEIB + NEIB; k++)
-							c[i][j] = c[i][j] + a[i][k] * b[k][j];
-	}
-	
-	return { omp_get_wtime() - now, nThreads };
+	if (strncmp(arg, "--mc=", 5) == 0) options.packed.mc = atoi(arg + 5);
+	else if (strncmp(arg, "--kc=", 5) == 0) options.packed.kc = atoi(arg + 5);
+	else if (strncmp(arg, "--nc=", 5) == 0) options.packed.nc = atoi(arg + 5);
+	else if (strncmp(arg, "--kernel=", 9) == 0) options.kernel = arg + 9;
+	else if (strncmp(arg, "--schedule=", 11) == 0) return parseSchedule(arg + 11, options.schedule);
+	else if (strcmp(arg, "--autotune") == 0) options.autotune = true;
+	else if (strcmp(arg, "--retune") == 0) options.autotune = options.retune = true;
+	else if (strncmp(arg, "--tuning-file=", 14) == 0) options.tuningFile = arg + 14;
+	else if (strncmp(arg, "--seed=", 7) == 0) options.seed = strtoull(arg + 7, nullptr, 10);
+	else if (strncmp(arg, "--numa=", 7) == 0) options.numa = arg + 7;
+	else if (strncmp(arg, "--cutoff=", 9) == 0) options.cutoff = atoi(arg + 9);
+	else if (strncmp(arg, "--task-depth=", 13) == 0) options.taskDepth = atoi(arg + 13);
+	else if (strncmp(arg, "--warmup=", 9) == 0) options.warmup = max(0, atoi(arg + 9));
+	else if (strncmp(arg, "--reps=", 7) == 0) options.reps = max(0, atoi(arg + 7));
+	else if (strcmp(arg, "--counters") == 0) options.counters = true;
+	else if (strncmp(arg, "--trace=", 8) == 0) options.trace = arg + 8;
+	else if (strncmp(arg, "--device=", 9) == 0) return parseDevice(arg + 9, options.device);
+	else if (strncmp(arg, "--grid=", 7) == 0)
+	{
+		char end;
+		return sscanf(arg + 7, "%dx%d%c", &options.grid[0], &options.grid[1], &end) == 2 && options.grid[0] > 0 &&
+		       options.grid[1] > 0;
+	}
+	else if (strncmp(arg, "--panel=", 8) == 0)
+	{
+		options.panel = atoi(arg + 8);
+		return options.panel > 0;
+	}
+	else if (strncmp(arg, "--format=", 9) == 0)
+	{
+		options.format = arg + 9;
+		return strcmp(options.format, "csv") == 0 || strcmp(options.format, "json") == 0;
+	}
+	else if (strcmp(arg, "--verify") == 0) options.verify = "auto";
+	else if (strncmp(arg, "--verify=", 9) == 0)
+	{
+		options.verify = arg + 9;
+		return strcmp(options.verify, "auto") == 0 || strcmp(options.verify, "full") == 0 ||
+		       strcmp(options.verify, "freivalds") == 0;
+	}
+	else if (strncmp(arg, "--tolerance=", 12) == 0)
+	{
+		options.tolerance = atof(arg + 12);
+		return options.tolerance > 0.0;
+	}
+	else if (strncmp(arg, "--load-a=", 9) == 0) options.load[0] = arg + 9;
+	else if (strncmp(arg, "--load-b=", 9) == 0) options.load[1] = arg + 9;
+	else if (strncmp(arg, "--store-a=", 10) == 0) options.store[0] = arg + 10;
+	else if (strncmp(arg, "--store-b=", 10) == 0) options.store[1] = arg + 10;
+	else if (strncmp(arg, "--store-c=", 10) == 0) options.store[2] = arg + 10;
+	else if (strncmp(arg, "--tile-memory=", 14) == 0)
+	{
+		options.tileMemory = atoi(arg + 14);
+		return options.tileMemory > 0;
+	}
+	else if (strncmp(arg, "--shape=", 8) == 0)
+	{
+		Shape& shape = options.shape;
+		char end;
+		return sscanf(arg + 8, "%dx%dx%d%c", &shape.m, &shape.k, &shape.n, &end) == 3 && shape.m > 0 &&
+		       shape.k > 0 && shape.n > 0;
+	}
+	else if (strcmp(arg, "--transpose-a") == 0) options.shape.transposeA = true;
+	else if (strcmp(arg, "--transpose-b") == 0) options.shape.transposeB = true;
+	else if (strncmp(arg, "--density=", 10) == 0)
+	{
+		options.density = atof(arg + 10);
+		return options.density >= 0.0 && options.density <= 1.0;
+	}
+	else if (strncmp(arg, "--sparse-threshold=", 19) == 0)
+	{
+		options.sparseThreshold = atof(arg + 19);
+		return options.sparseThreshold >= 0.0 && options.sparseThreshold <= 1.0;
+	}
+	else if (strncmp(arg, "--precision=", 12) == 0)
+	{
+		const Precision precisions[] = { fp64, fp32, fp32Accumulate64, bf16Accumulate32 };
+		for (Precision precision : precisions)
+		{
+			if (strcmp(arg + 12, precisionName(precision)) != 0) continue;
+			options.precision = precision;
+			return true;
+		}
+		return false;
+	}
+	else return false;
+	return true;
 }
 
-const Result standardMatrixMultiplication(vector<vector<double>>& a, vector<vector<double>>& b, 
-                                         vector<vector<double>>& c, int N, int nThreads)
+// Parse "kind[,chunk]" where kind is static, dynamic, guided or auto
+bool parseSchedule(const char* text, Schedule& schedule)
 {
-	double now = omp_get_wtime();
-	
-	#pragma omp parallel for num_threads(nThreads)
-	for (int i = 0; i < N; i++)
-		for (int j = 0; j < N; j++)
-			for (int k = 0; k < N; k++)
-				c[i][j] += a[i][k] * b[k][j];
-	
-	return { omp_get_wtime() - now, nThreads };
+	const char* comma = strchr(text, ',');
+	const size_t length = comma ? static_cast<size_t>(comma - text) : strlen(text);
+	const string kind(text, length);
+
+	if (kind == "static") schedule.kind = omp_sched_static;
+	else if (kind == "dynamic") schedule.kind = omp_sched_dynamic;
+	else if (kind == "guided") schedule.kind = omp_sched_guided;
+	else if (kind == "auto") schedule.kind = omp_sched_auto;
+	else return false;
+
+	schedule.chunk = comma ? atoi(comma + 1) : 0;
+	return schedule.chunk >= 0;
 }
 
-const Result sequentialMatrixMultiplication(vector<vector<double>>& a, vector<vector<double>>& b, 
-                                           vector<vector<double>>& c, int N)
+const char* scheduleName(const Schedule& schedule)
 {
-	double now = omp_get_wtime();
-	
-	// Pure sequential - no OpenMP directives
-	for (int i = 0; i < N; i++)
-		for (int j = 0; j < N; j++)
-			for (int k = 0; k < N; k++)
-				c[i][j] += a[i][k] * b[k][j];
-	
-	return { omp_get_wtime() - now, 1 };
+	switch (schedule.kind)
+	{
+	case omp_sched_static: return "static";
+	case omp_sched_dynamic: return "dynamic";
+	case omp_sched_guided: return "guided";
+	default: return "auto";
+	}
 }
 
-void initializeMatrix(vector<vector<double>>& matrix, int size, bool random)
+// The --shape sizes, or N for all three when none were given
+Shape problemShape(int N, const Options& options)
 {
-	random_device rd;
-	mt19937 gen(rd());
-	uniform_real_distribution<double> dis(0.0, 10.0);
-	
-	for (int i = 0; i < size; i++)
+	Shape shape = options.shape;
+	if (shape.m == 0) shape.m = shape.n = shape.k = N;
+	return shape;
+}
+
+Shape squareShape(int N)
+{
+	return { N, N, N, false, false };
+}
+
+// Strassen, NUMA mode, the autotuner and the out-of-core method take N x N operands as stored
+bool isSquare(const Shape& shape)
+{
+	return shape.m == shape.n && shape.n == shape.k && !shape.transposeA && !shape.transposeB;
+}
+
+const char* transposeName(const Shape& shape)
+{
+	if (shape.transposeA) return shape.transposeB ? "ab" : "a";
+	return shape.transposeB ? "b" : "none";
+}
+
+// Input type, then the accumulation and C type when they differ
+const char* precisionName(Precision precision)
+{
+	switch (precision)
 	{
-		for (int j = 0; j < size; j++)
-		{
-			if (random)
-				matrix[i][j] = dis(gen);
-			else
-				matrix[i][j] = i + j + 1;  // Simple pattern for testing
-		}
+	case fp32: return "fp32";
+	case fp32Accumulate64: return "fp32:fp64";
+	case bf16Accumulate32: return "bf16:fp32";
+	default: return "fp64";
 	}
 }
 
-void printMatrix(const vector<vector<double>>& matrix, int size, int maxDisplay)
+// "host", "gpu" (the default device) or a device number
+bool parseDevice(const char* text, int& device)
 {
-	int displaySize = min(size, maxDisplay);
-	for (int i = 0; i < displaySize; i++)
+	if (strcmp(text, "host") == 0) device = -1;
+	else if (strcmp(text, "gpu") == 0) device = omp_get_default_device();
+	else
 	{
-		cout << "   ";
-		for (int j = 0; j < displaySize; j++)
+		char* end;
+		device = static_cast<int>(strtol(text, &end, 10));
+		return end != text && *end == '\0' && device >= 0;
+	}
+	return true;
+}
+
+string deviceName(int device)
+{
+	return device < 0 ? "host" : "device" + to_string(device);
+}
+
+// Every work-sharing loop of the kernels is schedule(runtime), so the
+// --schedule choice set here reaches methods 1, 2, 4, 5 and Strassen's leaves.
+// NUMA mode uses the batch's setup when it was made for this block size and
+// team, otherwise it makes its own here, outside the kernel's timer.
+const Result runMethod(short method, const Matrix& a, const Matrix& b, Matrix& c, const Shape& shape, int NEIB,
+                       int nThreads, const Options& options, const NumaOperands<double>* numa)
+{
+	const int N = shape.n;
+	if ((method == 6 || (method == 5 && options.numa)) && !isSquare(shape))
+		throw invalid_argument("Strassen and NUMA mode need a square, untransposed product");
+
+	omp_set_schedule(options.schedule.kind, options.schedule.chunk);
+	switch (method)
+	{
+	case 1: return blockedMatrixMultiplication(a, b, c, shape, NEIB, nThreads);
+	case 2: return standardMatrixMultiplication(a, b, c, shape, nThreads);
+	case 3: return sequentialMatrixMultiplication(a, b, c, shape);
+	case 4: return packedMatrixMultiplication(a, b, c, shape, nThreads, options.packed, selectMicroKernel(options.kernel));
+	case 5:
+		if (options.device >= 0) return offloadedBlockedMatrixMultiplication(a, b, c, shape, NEIB, nThreads, options.device);
+		if (!options.numa) return collapsedBlockedMatrixMultiplication(a, b, c, shape, NEIB, nThreads, options.schedule);
+		if (numa && numa->NEIB == NEIB && numa->nThreads == nThreads)
+			return numaBlockedMatrixMultiplication(a, b, c, N, NEIB, nThreads, *numa);
+		return numaBlockedMatrixMultiplication(a, b, c, N, NEIB, nThreads, NumaOperands<double>(b, N, NEIB, nThreads));
+	case 6: return strassenMatrixMultiplication(a, b, c, N, nThreads, options.cutoff, options.taskDepth, options.packed,
+	                                            selectMicroKernel(options.kernel));
+	case 8: return sparseOrDenseMatrixMultiplication(a, b, c, shape, nThreads, options);
+	default: throw invalid_argument("Unknown method");
+	}
+}
+
+// Methods 1-5 with In operands accumulated in Out; the fp64 overload above
+// is the one chosen for double, and the only one with Strassen and NUMA
+template <typename In, typename Out>
+const Result runMethod(short method, const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                       const Shape& shape, int NEIB, int nThreads, const Options& options, const NumaOperands<In>*)
+{
+	omp_set_schedule(options.schedule.kind, options.schedule.chunk);
+	switch (method)
+	{
+	case 1: return blockedMatrixMultiplication(a, b, c, shape, NEIB, nThreads);
+	case 2: return standardMatrixMultiplication(a, b, c, shape, nThreads);
+	case 3: return sequentialMatrixMultiplication(a, b, c, shape);
+	case 4: return packedMatrixMultiplication(a, b, c, shape, nThreads, options.packed,
+	                                          selectMicroKernel<Out>(options.kernel));
+	case 5: return collapsedBlockedMatrixMultiplication(a, b, c, shape, NEIB, nThreads, options.schedule);
+	default: throw invalid_argument(string("Method not available with --precision=") + precisionName(options.precision));
+	}
+}
+
+// Batch mode with a thread count: with --reps, warm up and time each
+// repetition in this process, otherwise run once and print method,threads,time
+template <typename In, typename Out>
+int runBatch(short method, const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+             const Shape& shape, int NEIB, int nThreads, const Options& options)
+{
+	if (options.reps > 0)
+	{
+		vector<double> times;
+		unique_ptr<KernelCounters> counters(options.counters ? new KernelCounters(nThreads) : nullptr);
+		unique_ptr<DeviceOperands<In, Out>> onDevice(options.device >= 0 ?
+		                                             new DeviceOperands<In, Out>(a, b, c, options.device) : nullptr);
+		unique_ptr<NumaOperands<In>> numa(options.numa && method == 5 && isSquare(shape) ?
+		                                  new NumaOperands<In>(b, shape.n, NEIB, nThreads) : nullptr);
+		tracer.origin = omp_get_wtime();
+		tracer.timeline = options.trace != nullptr;
+		for (int run = 0; run < options.warmup + options.reps; run++)
 		{
-			cout << setw(8) << matrix[i][j] << " ";
+			c.fill(0.0, nThreads);
+			const bool measured = run >= options.warmup;
+			tracer.enabled = (options.trace || counters) && measured;
+			if (measured && counters) counters->start();
+			Result result = runMethod(method, a, b, c, shape, NEIB, nThreads, options, numa.get());
+			if (measured && counters) counters->stop();
+			if (measured) times.push_back(result.timestamp);
 		}
-		if (size > maxDisplay) cout << "...";
-		cout << endl;
+		tracer.enabled = false;
+		if (onDevice) onDevice->fetch();
+
+		const Statistics stats = summarize(times);
+		const double flops = 2.0 * shape.m * shape.n * shape.k;
+		vector<ReportField> report = {
+			field("method", method), field("threads", nThreads), field("m", shape.m), field("k", shape.k),
+			field("n", shape.n), field("transpose", string(transposeName(shape))), field("neib", NEIB),
+			field("warmup", options.warmup), field("reps", options.reps),
+			field("min", stats.min), field("median", stats.median), field("p95", stats.p95),
+			field("mean", stats.mean), field("stddev", stats.stddev), field("gflops", flops / stats.median * 1e-9),
+			field("schedule", string(scheduleName(options.schedule))), field("chunk", options.schedule.chunk),
+			field("precision", string(precisionName(options.precision))), field("device", deviceName(options.device))
+		};
+		if (counters) addCounterFields(report, *counters, options.reps, flops);
+		if (options.trace) addTraceFields(report);
+
+		// Check the product of the last measured run
+		bool verified = true;
+		if (options.verify)
+		{
+			verified = reportVerification(verifyResult(a, b, c, shape, options, nThreads), method, options.tolerance);
+			report.push_back(field("verified", string(verified ? "pass" : "fail")));
+		}
+		printReport(cout, report, options.format);
+		if (options.trace) reportTrace(options.trace);
+		return verified ? 0 : 2;
 	}
-	if (size > maxDisplay)
+
+	c.fill(0.0, nThreads);
+	unique_ptr<DeviceOperands<In, Out>> onDevice(options.device >= 0 ?
+	                                             new DeviceOperands<In, Out>(a, b, c, options.device) : nullptr);
+	tracer.origin = omp_get_wtime();
+	tracer.timeline = options.trace != nullptr;
+	tracer.enabled = options.trace;
+	Result result = runMethod(method, a, b, c, shape, NEIB, nThreads, options);
+	tracer.enabled = false;
+	if (onDevice) onDevice->fetch();
+
+	// Output in CSV format for Python parsing
+	cout << method << "," << nThreads << "," << fixed << setprecision(8) << result.timestamp << endl;
+	if (options.trace) reportTrace(options.trace);
+	if (options.verify &&
+	    !reportVerification(verifyResult(a, b, c, shape, options, nThreads), method, options.tolerance))
+		return 2;
+	return 0;
+}
+
+// Single or mixed precision: A and B are generated from the same seeded
+// values as fp64 and rounded to In, C accumulates in Out. Matrix files,
+// shared memory, NUMA placement and the autotuner stay fp64.
+template <typename In, typename Out>
+int runReducedPrecision(short method, const Shape& shape, int NEIB, int nThreads, const Options& options)
+{
+	if (options.autotune || options.numa || options.device >= 0 || options.load[0] || options.load[1] ||
+	    options.store[0] || options.store[1] || options.store[2])
+		throw invalid_argument(string("--autotune, --numa, --device and matrix files need --precision=fp64, not ") +
+		                       precisionName(options.precision));
+
+	BasicMatrix<In> a(shape.transposeA ? shape.k : shape.m, shape.transposeA ? shape.m : shape.k);
+	BasicMatrix<In> b(shape.transposeB ? shape.n : shape.k, shape.transposeB ? shape.k : shape.n);
+	BasicMatrix<Out> c(shape.m, shape.n);
+	initializeMatrix(a, options.seed, nThreads, shape.transposeA, options.density);
+	initializeMatrix(b, options.seed + 1, nThreads, shape.transposeB);
+	return runBatch(method, a, b, c, shape, NEIB, nThreads, options);
+}
+
+// Per-run averages of the counters. DRAM traffic is estimated as one 64-byte
+// line per last-level cache miss, which ignores prefetches and write-backs;
+// busy time is the work time of each team thread, and imbalance the busiest
+// thread over the mean (1 = perfectly even).
+void addCounterFields(vector<ReportField>& report, const KernelCounters& counters, int runs, double flops)
+{
+	const double cycles = counters.total(KernelCounters::cycles) / runs;
+	const double instructions = counters.total(KernelCounters::instructions) / runs;
+	const double dramBytes = 64.0 * counters.total(KernelCounters::llcMisses) / runs;
+	double busyMean = 0.0, busyMax = 0.0;
+	for (int thread = 0; thread < counters.nThreads; thread++)
 	{
-		cout << "   ..." << endl;
+		const double busy = counters.busy(thread) / runs;
+		busyMean += busy / counters.nThreads;
+		busyMax = std::isnan(busy) ? busy : max(busyMax, busy);
 	}
-	cout << endl;
+
+	report.push_back(field("cycles", cycles));
+	report.push_back(field("instructions", instructions));
+	report.push_back(field("ipc", instructions / cycles));
+	report.push_back(field("l1d_misses", counters.total(KernelCounters::l1dMisses) / runs));
+	report.push_back(field("llc_misses", dramBytes / 64.0));
+	report.push_back(field("dram_bytes", dramBytes));
+	report.push_back(field("intensity", flops / dramBytes));
+	report.push_back(field("busy_mean", busyMean));
+	report.push_back(field("busy_max", busyMax));
+	report.push_back(field("imbalance", busyMax / busyMean));
+}
+
+// The OpenMP runtime reads OMP_PROC_BIND/OMP_PLACES once at startup, so NUMA
+// mode sets them and re-executes the program unless they are already in the
+// environment. Explicit user settings are left alone.
+bool bindThreads(char* argv[], const char* binding)
+{
+	if (strcmp(binding, "close") != 0 && strcmp(binding, "spread") != 0) return false;
+	if (getenv("OMP_PROC_BIND")) return true;
+
+	setenv("OMP_PROC_BIND", binding, 1);
+	if (!getenv("OMP_PLACES")) setenv("OMP_PLACES", "cores", 1);
+#ifdef __linux__
+	execv("/proc/self/exe", argv);
+#endif
+	execvp(argv[0], argv);
+	cerr << "Warning: could not re-execute with OMP_PROC_BIND=" << binding << ", threads are not pinned" << endl;
+	return true;
+}
+
+// Parse a sysfs CPU list such as "0-7,16-23"
+static vector<int> parseCpuList(const string& text)
+{
+	vector<int> cpus;
+	istringstream ranges(text);
+	string range;
+	while (getline(ranges, range, ','))
+	{
+		const size_t dash = range.find('-');
+		const int first = atoi(range.c_str());
+		const int last = dash == string::npos ? first : atoi(range.c_str() + dash + 1);
+		for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+	}
+	return cpus;
 }
 
-bool verifyResult(const vector<vector<double>>& c1, const vector<vector<double>>& c2, int size)
+const Topology& topology()
 {
-	const double epsilon = 1e-9;
-	for (int i = 0; i < size; i++)
+	static Topology host;
+	if (!host.cpuNode.empty()) return host;
+
+	host.nodes = 1;
+	host.cpuNode.assign(max(1, omp_get_num_procs()), 0);
+#ifdef __linux__
+	for (int node = 0; ; node++)
 	{
-		for (int j = 0; j < size; j++)
+		ifstream list("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+		string text;
+		if (!getline(list, text)) break;
+		for (int cpu : parseCpuList(text))
 		{
-			if (abs(c1[i][j] - c2[i][j]) > epsilon)
-				return false;
+			if (cpu >= static_cast<int>(host.cpuNode.size())) host.cpuNode.resize(cpu + 1, 0);
+			host.cpuNode[cpu] = node;
 		}
+		host.nodes = node + 1;
 	}
-	return true;
+#endif
+	return host;
+}
+
+// NUMA node of the CPU the calling thread is running on
+int currentNode()
+{
+#ifdef __linux__
+	const int cpu = sched_getcpu();
+	const Topology& host = topology();
+	if (cpu >= 0 && cpu < static_cast<int>(host.cpuNode.size())) return host.cpuNode[cpu];
+#endif
+	return 0;
+}
+
+static const char* procBindName(omp_proc_bind_t bind)
+{
+	switch (bind)
+	{
+	case omp_proc_bind_false: return "false";
+	case omp_proc_bind_true: return "true";
+	case omp_proc_bind_master: return "master";
+	case omp_proc_bind_close: return "close";
+	case omp_proc_bind_spread: return "spread";
+	default: return "unknown";
+	}
+}
+
+void reportTopology(ostream& out, int nThreads)
+{
+	const Topology& host = topology();
+	vector<int> threadNode(nThreads), threadPlace(nThreads);
+
+	#pragma omp parallel num_threads(nThreads)
+	{
+		threadNode[omp_get_thread_num()] = currentNode();
+		threadPlace[omp_get_thread_num()] = omp_get_place_num();
+	}
+
+	vector<int> perNode(host.nodes, 0);
+	for (int node : threadNode) perNode[node]++;
+
+	out << "Topology: " << host.nodes << " NUMA node(s), " << omp_get_num_places() << " places, proc_bind="
+	    << procBindName(omp_get_proc_bind()) << endl;
+	for (int node = 0; node < host.nodes; node++)
+		out << "  node " << node << ": " << perNode[node] << " thread(s)" << endl;
+	out << "  thread -> place/node:";
+	for (int t = 0; t < nThreads; t++) out << " " << t << "->" << threadPlace[t] << "/" << threadNode[t];
+	out << endl;
+}
+
+// Tuning results are shared by every N in [2^k, 2^(k+1)); long long, since
+// doubling an int past 2^30 overflows
+static long long tuningBucket(int N)
+{
+	long long bucket = 1;
+	while (bucket * 2 <= N) bucket *= 2;
+	return bucket;
+}
+
+// The tuning file holds one tab-separated entry per line:
+//   cpu model, method, N from, N to, NEIB, threads, schedule
+// Later lines override earlier ones, so a retune simply appends.
+static bool loadTuning(const char* path, const string& cpu, short method, int N, Tuning& tuning)
+{
+	ifstream in(path);
+	string line;
+	bool found = false;
+	while (getline(in, line))
+	{
+		istringstream fields(line);
+		string model, schedule;
+		int entryMethod;
+		long long from, to;
+		Tuning entry;
+		if (!getline(fields, model, '\t')) continue;
+		if (!(fields >> entryMethod >> from >> to >> entry.neib >> entry.threads >> schedule)) continue;
+		if (model != cpu || entryMethod != method || N < from || N > to) continue;
+		if (!parseSchedule(schedule.c_str(), entry.schedule)) continue;
+		tuning = entry;
+		found = true;
+	}
+	return found;
+}
+
+static void saveTuning(const char* path, const string& cpu, short method, int N, const Tuning& tuning)
+{
+	ofstream out(path, ios::app);
+	const long long bucket = tuningBucket(N);
+	out << cpu << '\t' << method << '\t' << bucket << '\t' << 2 * bucket - 1 << '\t' << tuning.neib << '\t'
+	    << tuning.threads << '\t' << scheduleName(tuning.schedule) << ',' << tuning.schedule.chunk << endl;
+}
+
+// Time one configuration; quick runs are repeated and the best time kept
+static double timeTuning(short method, const Matrix& a, const Matrix& b, Matrix& c, int N, const Tuning& tuning,
+                         Options options)
+{
+	options.schedule = tuning.schedule;
+	double best = 0.0;
+	for (int run = 0; run < 3; run++)
+	{
+		c.fill(0.0);
+		const double time = runMethod(method, a, b, c, squareShape(N), tuning.neib, tuning.threads, options).timestamp;
+		if (run == 0 || time < best) best = time;
+		if (time > 0.1) break;
+	}
+	return best;
+}
+
+// Coordinate search for the blocked methods: block size at full thread count,
+// then the schedule, then the thread count. Each step
+// keeps the best value found before moving on to the next parameter.
+static const Tuning searchTuning(short method, const Matrix& a, const Matrix& b, Matrix& c, int N,
+                                 const Options& options)
+{
+	const int procs = omp_get_num_procs();
+	const int blockSizes[] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+	const Schedule schedules[] = { { omp_sched_static, 0 }, { omp_sched_dynamic, 1 }, { omp_sched_guided, 0 } };
+
+	Tuning best = { min(N, blockSizes[0]), procs, options.schedule };
+	double bestTime = timeTuning(method, a, b, c, N, best, options);
+
+	for (int neib : blockSizes)
+	{
+		if (neib > N || neib == best.neib) continue;
+		Tuning candidate = best;
+		candidate.neib = neib;
+		const double time = timeTuning(method, a, b, c, N, candidate, options);
+		if (time < bestTime) { best = candidate; bestTime = time; }
+	}
+
+	for (const Schedule& schedule : schedules)
+	{
+		Tuning candidate = best;
+		candidate.schedule = schedule;
+		const double time = timeTuning(method, a, b, c, N, candidate, options);
+		if (time < bestTime) { best = candidate; bestTime = time; }
+	}
+
+	for (int threads = 1; threads < procs; threads *= 2)
+	{
+		Tuning candidate = best;
+		candidate.threads = threads;
+		const double time = timeTuning(method, a, b, c, N, candidate, options);
+		if (time < bestTime) { best = candidate; bestTime = time; }
+	}
+
+	return best;
+}
+
+// Look up the tuning for this host and N, running the search and recording
+// its winner when there is no entry yet (or when a retune was requested)
+const Tuning findTuning(short method, const Matrix& a, const Matrix& b, Matrix& c, int N, const Options& options)
+{
+	if (method != 1 && method != 5) throw invalid_argument("Autotuning is only available for the blocked methods");
+
+	const string cpu = cpuModel();
+	Tuning tuning;
+	const bool cached = !options.retune && loadTuning(options.tuningFile, cpu, method, N, tuning);
+	if (!cached)
+	{
+		tuning = searchTuning(method, a, b, c, N, options);
+		saveTuning(options.tuningFile, cpu, method, N, tuning);
+	}
+
+	cerr << "Autotune (" << (cached ? "cached" : "searched") << "): NEIB=" << tuning.neib
+	     << " threads=" << tuning.threads << " schedule=" << scheduleName(tuning.schedule) << ','
+	     << tuning.schedule.chunk << endl;
+	return tuning;
+}
+
+// sum + op(A)(i, 0:k) . op(B)(0:k, j), given the first element of each and
+// their strides along k. Operands are widened to the accumulation type Out
+// before multiplying.
+template <typename In, typename Out>
+static inline Out dotProduct(int k, const In* a, size_t aStride, const In* b, size_t bStride, Out sum)
+{
+	for (int p = 0; p < k; p++)
+		sum += static_cast<Out>(a[p * aStride]) * static_cast<Out>(b[p * bStride]);
+	return sum;
+}
+
+// c[p, q] += a[p, r] * b[r, q] for one tile of each operand. Tiles are
+// NEIB x NEIB except in the last block row/column when NEIB does not divide
+// the dimension; those remainder tiles run the same loops over their clipped
+// extent.
+template <typename In, typename Out>
+static inline void multiplyTile(const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                                const Shape& shape, int p, int q, int r, int NEIB)
+{
+	const int iEnd = min(p * NEIB + NEIB, shape.m);
+	const int jEnd = min(q * NEIB + NEIB, shape.n);
+	const int k0 = r * NEIB, kEnd = min(k0 + NEIB, shape.k);
+	const Strides sa = Strides::of(a.ld, shape.transposeA), sb = Strides::of(b.ld, shape.transposeB);
+
+	for (int i = p * NEIB; i < iEnd; i++)
+	{
+		const In* ai = a.data + i * sa.row + k0 * sa.col;
+		Out* ci = c.row(i);
+		for (int j = q * NEIB; j < jEnd; j++)
+			ci[j] = dotProduct(kEnd - k0, ai, sa.col, b.data + k0 * sb.row + j * sb.col, sb.row, ci[j]);
+	}
+}
+
+// One parallel region per block row of C, or per block column when C is
+// taller than it is wide, so the team always splits the longer side and a
+// tall-skinny product still has a tile for every thread.
+template <typename In, typename Out>
+const Result blockedMatrixMultiplication(const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                                         const Shape& shape, int NEIB, int nThreads)
+{
+	// Number of blocks per dimension, counting a partial last block
+	const int MB = (shape.m + NEIB - 1) / NEIB, NB = (shape.n + NEIB - 1) / NEIB, KB = (shape.k + NEIB - 1) / NEIB;
+	double now = omp_get_wtime();
+
+	int p, q, r;
+
+	if (NB >= MB)
+	{
+		for (p = 0; p < MB; p++) {
+			tracer.begin("blocked block row", nThreads);
+			#pragma omp parallel for default(shared) private(q, r) schedule(runtime) num_threads(nThreads)
+			for (q = 0; q < NB; q++)
+			{
+				TracedIteration traced;
+				for (r = 0; r < KB; r++)
+					multiplyTile(a, b, c, shape, p, q, r, NEIB);
+			}
+			tracer.end();
+		}
+	}
+	else
+	{
+		for (q = 0; q < NB; q++) {
+			tracer.begin("blocked block column", nThreads);
+			#pragma omp parallel for default(shared) private(p, r) schedule(runtime) num_threads(nThreads)
+			for (p = 0; p < MB; p++)
+			{
+				TracedIteration traced;
+				for (r = 0; r < KB; r++)
+					multiplyTile(a, b, c, shape, p, q, r, NEIB);
+			}
+			tracer.end();
+		}
+	}
+
+	return { omp_get_wtime() - now, nThreads };
+}
+
+// Same tiles as blockedMatrixMultiplication, but the whole MB x NB tile space
+// is scheduled by one parallel loop: a single fork/join per multiply and MB*NB
+// independent tiles to balance instead of NB per region, whatever the shape.
+// Each (p, q) tile of c belongs to exactly one iteration, so no
+// synchronization is needed.
+template <typename In, typename Out>
+const Result collapsedBlockedMatrixMultiplication(const BasicMatrix<In>& a, const BasicMatrix<In>& b,
+                                                  BasicMatrix<Out>& c, const Shape& shape, int NEIB, int nThreads,
+                                                  const Schedule& schedule)
+{
+	// Number of blocks per dimension, counting a partial last block
+	const int MB = (shape.m + NEIB - 1) / NEIB, NB = (shape.n + NEIB - 1) / NEIB, KB = (shape.k + NEIB - 1) / NEIB;
+	double now = omp_get_wtime();
+
+	omp_set_schedule(schedule.kind, schedule.chunk);
+
+	tracer.begin("collapsed blocked", nThreads);
+	#pragma omp parallel for collapse(2) schedule(runtime) num_threads(nThreads)
+	for (int p = 0; p < MB; p++)
+		for (int q = 0; q < NB; q++)
+		{
+			TracedIteration traced;
+			for (int r = 0; r < KB; r++)
+				multiplyTile(a, b, c, shape, p, q, r, NEIB);
+		}
+	tracer.end();
+
+	return { omp_get_wtime() - now, nThreads };
+}
+
+// Method 5 on an OpenMP device. The collapsed tile space is extended by the
+// elements of each NEIB x NEIB tile, so consecutive iterations, and with them
+// the threads of a team, walk one tile of C row by row while the teams share
+// out the tiles. Each element is a full dot product written to C, which the
+// batch has zeroed anyway, so the device copy of C never has to be cleared
+// or fetched between runs. Operands mapped by DeviceOperands are found
+// present and not copied; without it each call maps them itself.
+const Result offloadedBlockedMatrixMultiplication(const Matrix& a, const Matrix& b, Matrix& c, const Shape& shape,
+                                                  int NEIB, int nThreads, int device)
+{
+	const int MB = (shape.m + NEIB - 1) / NEIB, NB = (shape.n + NEIB - 1) / NEIB;
+	const int m = shape.m, n = shape.n, k = shape.k, ldc = c.ld;
+	const Strides sa = Strides::of(a.ld, shape.transposeA), sb = Strides::of(b.ld, shape.transposeB);
+	const size_t aRow = sa.row, aCol = sa.col, bRow = sb.row, bCol = sb.col;
+	const double* A = a.data;
+	const double* B = b.data;
+	double* C = c.data;
+	const size_t sizeA = static_cast<size_t>(a.rows) * a.ld, sizeB = static_cast<size_t>(b.rows) * b.ld;
+	const size_t sizeC = static_cast<size_t>(c.rows) * c.ld;
+	double now = omp_get_wtime();
+
+	#pragma omp target teams distribute parallel for collapse(4) device(device) \
+		map(to: A[0:sizeA], B[0:sizeB]) map(tofrom: C[0:sizeC])
+	for (int p = 0; p < MB; p++)
+		for (int q = 0; q < NB; q++)
+			for (int ii = 0; ii < NEIB; ii++)
+				for (int jj = 0; jj < NEIB; jj++)
+				{
+					const int i = p * NEIB + ii, j = q * NEIB + jj;
+					if (i >= m || j >= n) continue;
+					double sum = 0.0;
+					for (int r = 0; r < k; r++) sum += A[i * aRow + r * aCol] * B[r * bRow + j * bCol];
+					C[static_cast<size_t>(i) * ldc + j] = sum;
+				}
+
+	return { omp_get_wtime() - now, nThreads };
+}
+
+template <typename In, typename Out>
+DeviceOperands<In, Out>::DeviceOperands(const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                                        int device)
+	: a(a.data), b(b.data), c(c.data), sizeA(static_cast<size_t>(a.rows) * a.ld),
+	  sizeB(static_cast<size_t>(b.rows) * b.ld), sizeC(static_cast<size_t>(c.rows) * c.ld), device(device)
+{
+	#pragma omp target enter data device(device) map(to: this->a[0:sizeA], this->b[0:sizeB], this->c[0:sizeC])
+}
+
+template <typename In, typename Out>
+void DeviceOperands<In, Out>::fetch()
+{
+	#pragma omp target update device(device) from(c[0:sizeC])
+}
+
+template <typename In, typename Out>
+DeviceOperands<In, Out>::~DeviceOperands()
+{
+	#pragma omp target exit data device(device) map(release: a[0:sizeA], b[0:sizeB], c[0:sizeC])
+}
+
+// The parallel loop runs over the rows of C, or over its columns when C is
+// wider than it is tall
+template <typename In, typename Out>
+const Result standardMatrixMultiplication(const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                                          const Shape& shape, int nThreads)
+{
+	const Strides sa = Strides::of(a.ld, shape.transposeA), sb = Strides::of(b.ld, shape.transposeB);
+	double now = omp_get_wtime();
+
+	tracer.begin("standard", nThreads);
+	if (shape.m >= shape.n)
+	{
+		#pragma omp parallel for schedule(runtime) num_threads(nThreads)
+		for (int i = 0; i < shape.m; i++)
+		{
+			TracedIteration traced;
+			Out* ci = c.row(i);
+			for (int j = 0; j < shape.n; j++)
+				ci[j] = dotProduct(shape.k, a.data + i * sa.row, sa.col, b.data + j * sb.col, sb.row, ci[j]);
+		}
+	}
+	else
+	{
+		#pragma omp parallel for schedule(runtime) num_threads(nThreads)
+		for (int j = 0; j < shape.n; j++)
+		{
+			TracedIteration traced;
+			for (int i = 0; i < shape.m; i++)
+			{
+				Out& cij = c.row(i)[j];
+				cij = dotProduct(shape.k, a.data + i * sa.row, sa.col, b.data + j * sb.col, sb.row, cij);
+			}
+		}
+	}
+	tracer.end();
+
+	return { omp_get_wtime() - now, nThreads };
+}
+
+template <typename In, typename Out>
+const Result sequentialMatrixMultiplication(const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                                            const Shape& shape)
+{
+	const Strides sa = Strides::of(a.ld, shape.transposeA), sb = Strides::of(b.ld, shape.transposeB);
+	double now = omp_get_wtime();
+
+	// Pure sequential - no OpenMP directives
+	for (int i = 0; i < shape.m; i++)
+	{
+		Out* ci = c.row(i);
+		for (int j = 0; j < shape.n; j++)
+			ci[j] = dotProduct(shape.k, a.data + i * sa.row, sa.col, b.data + j * sb.col, sb.row, ci[j]);
+	}
+
+	return { omp_get_wtime() - now, 1 };
+}
+
+template <typename In, typename Out>
+const Result packedMatrixMultiplication(const BasicMatrix<In>& a, const BasicMatrix<In>& b, BasicMatrix<Out>& c,
+                                        const Shape& shape, int nThreads, const PackedParams& params,
+                                        const MicroKernelOf<Out>& kernel)
+{
+	double now = omp_get_wtime();
+
+	gemmPacked(shape.m, shape.n, shape.k, a.data, a.ld, b.data, b.ld, c.data, c.ld, params, kernel, nThreads,
+	           shape.transposeA, shape.transposeB);
+
+	return { omp_get_wtime() - now, nThreads };
+}
+
+// Copy an mc x kc block of op(A) into row panels of mr values per column, the
+// order in which the micro-kernel consumes them. Short panels are zero padded.
+// Packing is also where reduced-precision inputs widen to the kernel's type,
+// and where transposed operands are read along their stored columns.
+template <typename In, typename Out>
+static void packA(int mc, int kc, const In* a, const Strides& stride, Out* buffer, int mr)
+{
+	for (int i = 0; i < mc; i += mr)
+	{
+		const int rows = min(mr, mc - i);
+		for (int p = 0; p < kc; p++)
+		{
+			for (int r = 0; r < rows; r++) buffer[r] = static_cast<Out>(a[(i + r) * stride.row + p * stride.col]);
+			for (int r = rows; r < mr; r++) buffer[r] = 0;
+			buffer += mr;
+		}
+	}
+}
+
+// Copy one kc x nr column panel of op(B), row by row, zero padding short panels
+template <typename In, typename Out>
+static void packBPanel(int kc, int cols, const In* b, const Strides& stride, Out* buffer, int nr)
+{
+	for (int p = 0; p < kc; p++)
+	{
+		const In* bp = b + p * stride.row;
+		for (int j = 0; j < cols; j++) buffer[j] = static_cast<Out>(bp[j * stride.col]);
+		for (int j = cols; j < nr; j++) buffer[j] = 0;
+		buffer += nr;
+	}
+}
+
+// C[0:rows, 0:cols] += packed A panel * packed B panel. Edge tiles go through
+// a scratch tile so the kernel never reads or writes past the end of C.
+template <typename Out>
+static inline void multiplyPanels(const MicroKernelOf<Out>& kernel, int kc, const Out* ap, const Out* bp, Out* cp,
+                                  int ldc, int rows, int cols, Out* edge)
+{
+	const int mr = kernel.mr, nr = kernel.nr;
+	if (rows == mr && cols == nr)
+	{
+		kernel.compute(kc, ap, bp, cp, ldc);
+		return;
+	}
+
+	for (int e = 0; e < mr * nr; e++) edge[e] = 0;
+	kernel.compute(kc, ap, bp, edge, nr);
+	for (int r = 0; r < rows; r++)
+		for (int j = 0; j < cols; j++)
+			cp[static_cast<size_t>(r) * ldc + j] += edge[r * nr + j];
+}
+
+// Packing buffers of the calling thread, kept between calls and shared by every precision
+static thread_local ScratchBuffer packBufferA, packBufferB;
+
+// C += op(A) * op(B) for row-major operands, where op transposes A (stored
+// k x m) and B (stored n x k) when asked. The jc/pc loops walk NC x KC panels
+// of op(B), which the team packs together. Normally ic blocks of A are then
+// shared out between threads, each packing its own MC x KC panel and sweeping
+// the micro-kernel over it. When C has fewer MR row panels than there are
+// threads (short and wide), the team instead packs each A block together and
+// shares out its NR column panels, so every thread still has work.
+template <typename In, typename Out>
+void gemmPacked(int m, int n, int k, const In* a, int lda, const In* b, int ldb, Out* c, int ldc,
+                const PackedParams& params, const MicroKernelOf<Out>& kernel, int nThreads, bool transposeA,
+                bool transposeB)
+{
+	const int mr = kernel.mr, nr = kernel.nr;
+	const int kc = max(1, params.kc);
+	const int nc = max(nr, params.nc / nr * nr);
+	const Strides sa = Strides::of(lda, transposeA), sb = Strides::of(ldb, transposeB);
+	const int rowPanels = (m + mr - 1) / mr;
+	const bool splitColumns = rowPanels < nThreads && (n + nr - 1) / nr > rowPanels;
+	// Shrink MC when there are too few row blocks to keep every thread busy
+	const int mcBalanced = splitColumns ? rowPanels * mr : ((m + nThreads - 1) / nThreads + mr - 1) / mr * mr;
+	const int mc = max(mr, min(params.mc / mr * mr, mcBalanced));
+
+	Out* packedB = packBufferB.reserveAs<Out>(static_cast<size_t>(kc) * nc);
+	Out* sharedA = splitColumns ? packBufferA.reserveAs<Out>(static_cast<size_t>(mc) * kc) : nullptr;
+
+	tracer.begin("packed", nThreads);
+	#pragma omp parallel num_threads(nThreads)
+	{
+		Out* packedA = splitColumns ? sharedA : packBufferA.reserveAs<Out>(static_cast<size_t>(mc) * kc);
+		alignas(Matrix::alignment) Out edge[MicroKernelOf<Out>::maxMR * MicroKernelOf<Out>::maxNR];
+
+		for (int jc = 0; jc < n; jc += nc)
+		{
+			const int nb = min(nc, n - jc);
+			const int panels = (nb + nr - 1) / nr;
+
+			for (int pc = 0; pc < k; pc += kc)
+			{
+				const int kb = min(kc, k - pc);
+
+				#pragma omp for schedule(runtime)
+				for (int jp = 0; jp < panels; jp++)
+				{
+					TracedIteration traced;
+					packBPanel(kb, min(nr, nb - jp * nr), b + pc * sb.row + (jc + jp * nr) * sb.col, sb,
+					           packedB + static_cast<size_t>(jp) * kb * nr, nr);
+				}
+
+				if (splitColumns)
+				{
+					for (int ic = 0; ic < m; ic += mc)
+					{
+						const int mb = min(mc, m - ic);
+
+						#pragma omp for schedule(runtime)
+						for (int ip = 0; ip < (mb + mr - 1) / mr; ip++)
+						{
+							TracedIteration traced;
+							packA(min(mr, mb - ip * mr), kb, a + (ic + ip * mr) * sa.row + pc * sa.col, sa,
+							      packedA + static_cast<size_t>(ip) * kb * mr, mr);
+						}
+
+						#pragma omp for schedule(runtime)
+						for (int jp = 0; jp < panels; jp++)
+						{
+							TracedIteration traced;
+							for (int ir = 0; ir < mb; ir += mr)
+								multiplyPanels(kernel, kb, packedA + static_cast<size_t>(ir / mr) * kb * mr,
+								               packedB + static_cast<size_t>(jp) * kb * nr,
+								               c + static_cast<size_t>(ic + ir) * ldc + jc + jp * nr, ldc,
+								               min(mr, mb - ir), min(nr, nb - jp * nr), edge);
+						}
+					}
+					continue;
+				}
+
+				#pragma omp for schedule(runtime)
+				for (int ic = 0; ic < m; ic += mc)
+				{
+					TracedIteration traced;
+					const int mb = min(mc, m - ic);
+					packA(mb, kb, a + ic * sa.row + pc * sa.col, sa, packedA, mr);
+
+					for (int jr = 0; jr < nb; jr += nr)
+					{
+						const Out* bp = packedB + static_cast<size_t>(jr / nr) * kb * nr;
+
+						for (int ir = 0; ir < mb; ir += mr)
+							multiplyPanels(kernel, kb, packedA + static_cast<size_t>(ir / mr) * kb * mr, bp,
+							               c + static_cast<size_t>(ic + ir) * ldc + jc + jr, ldc, min(mr, mb - ir),
+							               min(nr, nb - jr), edge);
+					}
+				}
+			}
+		}
+	}
+	tracer.end();
+}
+
+// Portable kernel of 4 rows by one cache line, 4x8 for double and 4x16 for
+// float; the fixed trip counts let the compiler vectorize it
+template <typename T>
+static void microKernelGeneric(int kc, const T* a, const T* b, T* c, int ldc)
+{
+	const int nr = 64 / sizeof(T);
+	T acc[4][nr] = {};
+	for (int p = 0; p < kc; p++)
+	{
+		for (int r = 0; r < 4; r++)
+			for (int j = 0; j < nr; j++)
+				acc[r][j] += a[r] * b[j];
+		a += 4;
+		b += nr;
+	}
+	for (int r = 0; r < 4; r++)
+		for (int j = 0; j < nr; j++)
+			c[static_cast<size_t>(r) * ldc + j] += acc[r][j];
+}
+
+#ifdef HAVE_X86_MICROKERNELS
+// 6x8 AVX2 kernel: twelve ymm accumulators, two B loads and six broadcasts
+// of A per step of k
+__attribute__((target("avx2,fma")))
+static void microKernelAvx2(int kc, const double* a, const double* b, double* c, int ldc)
+{
+	__m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+	__m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+	__m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+	__m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+	__m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+	__m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+	for (int p = 0; p < kc; p++)
+	{
+		const __m256d b0 = _mm256_load_pd(b), b1 = _mm256_load_pd(b + 4);
+		__m256d ai;
+		ai = _mm256_broadcast_sd(a + 0); c00 = _mm256_fmadd_pd(ai, b0, c00); c01 = _mm256_fmadd_pd(ai, b1, c01);
+		ai = _mm256_broadcast_sd(a + 1); c10 = _mm256_fmadd_pd(ai, b0, c10); c11 = _mm256_fmadd_pd(ai, b1, c11);
+		ai = _mm256_broadcast_sd(a + 2); c20 = _mm256_fmadd_pd(ai, b0, c20); c21 = _mm256_fmadd_pd(ai, b1, c21);
+		ai = _mm256_broadcast_sd(a + 3); c30 = _mm256_fmadd_pd(ai, b0, c30); c31 = _mm256_fmadd_pd(ai, b1, c31);
+		ai = _mm256_broadcast_sd(a + 4); c40 = _mm256_fmadd_pd(ai, b0, c40); c41 = _mm256_fmadd_pd(ai, b1, c41);
+		ai = _mm256_broadcast_sd(a + 5); c50 = _mm256_fmadd_pd(ai, b0, c50); c51 = _mm256_fmadd_pd(ai, b1, c51);
+		a += 6;
+		b += 8;
+	}
+
+	const __m256d rows[6][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 }, { c40, c41 }, { c50, c51 } };
+	for (int r = 0; r < 6; r++)
+	{
+		double* cr = c + static_cast<size_t>(r) * ldc;
+		_mm256_storeu_pd(cr, _mm256_add_pd(_mm256_loadu_pd(cr), rows[r][0]));
+		_mm256_storeu_pd(cr + 4, _mm256_add_pd(_mm256_loadu_pd(cr + 4), rows[r][1]));
+	}
+}
+
+// 6x16 AVX-512 kernel: the same shape as the AVX2 one on zmm registers
+__attribute__((target("avx512f")))
+static void microKernelAvx512(int kc, const double* a, const double* b, double* c, int ldc)
+{
+	__m512d c00 = _mm512_setzero_pd(), c01 = _mm512_setzero_pd();
+	__m512d c10 = _mm512_setzero_pd(), c11 = _mm512_setzero_pd();
+	__m512d c20 = _mm512_setzero_pd(), c21 = _mm512_setzero_pd();
+	__m512d c30 = _mm512_setzero_pd(), c31 = _mm512_setzero_pd();
+	__m512d c40 = _mm512_setzero_pd(), c41 = _mm512_setzero_pd();
+	__m512d c50 = _mm512_setzero_pd(), c51 = _mm512_setzero_pd();
+
+	for (int p = 0; p < kc; p++)
+	{
+		const __m512d b0 = _mm512_load_pd(b), b1 = _mm512_load_pd(b + 8);
+		__m512d ai;
+		ai = _mm512_set1_pd(a[0]); c00 = _mm512_fmadd_pd(ai, b0, c00); c01 = _mm512_fmadd_pd(ai, b1, c01);
+		ai = _mm512_set1_pd(a[1]); c10 = _mm512_fmadd_pd(ai, b0, c10); c11 = _mm512_fmadd_pd(ai, b1, c11);
+		ai = _mm512_set1_pd(a[2]); c20 = _mm512_fmadd_pd(ai, b0, c20); c21 = _mm512_fmadd_pd(ai, b1, c21);
+		ai = _mm512_set1_pd(a[3]); c30 = _mm512_fmadd_pd(ai, b0, c30); c31 = _mm512_fmadd_pd(ai, b1, c31);
+		ai = _mm512_set1_pd(a[4]); c40 = _mm512_fmadd_pd(ai, b0, c40); c41 = _mm512_fmadd_pd(ai, b1, c41);
+		ai = _mm512_set1_pd(a[5]); c50 = _mm512_fmadd_pd(ai, b0, c50); c51 = _mm512_fmadd_pd(ai, b1, c51);
+		a += 6;
+		b += 16;
+	}
+
+	const __m512d rows[6][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 }, { c40, c41 }, { c50, c51 } };
+	for (int r = 0; r < 6; r++)
+	{
+		double* cr = c + static_cast<size_t>(r) * ldc;
+		_mm512_storeu_pd(cr, _mm512_add_pd(_mm512_loadu_pd(cr), rows[r][0]));
+		_mm512_storeu_pd(cr + 8, _mm512_add_pd(_mm512_loadu_pd(cr + 8), rows[r][1]));
+	}
+}
+
+// Single precision: the same 6-row shapes with twice the lanes, 6x16 on AVX2
+__attribute__((target("avx2,fma")))
+static void microKernelAvx2(int kc, const float* a, const float* b, float* c, int ldc)
+{
+	__m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+	__m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+	__m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+	__m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+	__m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+	__m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+	for (int p = 0; p < kc; p++)
+	{
+		const __m256 b0 = _mm256_load_ps(b), b1 = _mm256_load_ps(b + 8);
+		__m256 ai;
+		ai = _mm256_broadcast_ss(a + 0); c00 = _mm256_fmadd_ps(ai, b0, c00); c01 = _mm256_fmadd_ps(ai, b1, c01);
+		ai = _mm256_broadcast_ss(a + 1); c10 = _mm256_fmadd_ps(ai, b0, c10); c11 = _mm256_fmadd_ps(ai, b1, c11);
+		ai = _mm256_broadcast_ss(a + 2); c20 = _mm256_fmadd_ps(ai, b0, c20); c21 = _mm256_fmadd_ps(ai, b1, c21);
+		ai = _mm256_broadcast_ss(a + 3); c30 = _mm256_fmadd_ps(ai, b0, c30); c31 = _mm256_fmadd_ps(ai, b1, c31);
+		ai = _mm256_broadcast_ss(a + 4); c40 = _mm256_fmadd_ps(ai, b0, c40); c41 = _mm256_fmadd_ps(ai, b1, c41);
+		ai = _mm256_broadcast_ss(a + 5); c50 = _mm256_fmadd_ps(ai, b0, c50); c51 = _mm256_fmadd_ps(ai, b1, c51);
+		a += 6;
+		b += 16;
+	}
+
+	const __m256 rows[6][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 }, { c40, c41 }, { c50, c51 } };
+	for (int r = 0; r < 6; r++)
+	{
+		float* cr = c + static_cast<size_t>(r) * ldc;
+		_mm256_storeu_ps(cr, _mm256_add_ps(_mm256_loadu_ps(cr), rows[r][0]));
+		_mm256_storeu_ps(cr + 8, _mm256_add_ps(_mm256_loadu_ps(cr + 8), rows[r][1]));
+	}
+}
+
+// 6x32 single-precision AVX-512 kernel
+__attribute__((target("avx512f")))
+static void microKernelAvx512(int kc, const float* a, const float* b, float* c, int ldc)
+{
+	__m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+	__m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+	__m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+	__m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+	__m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps();
+	__m512 c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+
+	for (int p = 0; p < kc; p++)
+	{
+		const __m512 b0 = _mm512_load_ps(b), b1 = _mm512_load_ps(b + 16);
+		__m512 ai;
+		ai = _mm512_set1_ps(a[0]); c00 = _mm512_fmadd_ps(ai, b0, c00); c01 = _mm512_fmadd_ps(ai, b1, c01);
+		ai = _mm512_set1_ps(a[1]); c10 = _mm512_fmadd_ps(ai, b0, c10); c11 = _mm512_fmadd_ps(ai, b1, c11);
+		ai = _mm512_set1_ps(a[2]); c20 = _mm512_fmadd_ps(ai, b0, c20); c21 = _mm512_fmadd_ps(ai, b1, c21);
+		ai = _mm512_set1_ps(a[3]); c30 = _mm512_fmadd_ps(ai, b0, c30); c31 = _mm512_fmadd_ps(ai, b1, c31);
+		ai = _mm512_set1_ps(a[4]); c40 = _mm512_fmadd_ps(ai, b0, c40); c41 = _mm512_fmadd_ps(ai, b1, c41);
+		ai = _mm512_set1_ps(a[5]); c50 = _mm512_fmadd_ps(ai, b0, c50); c51 = _mm512_fmadd_ps(ai, b1, c51);
+		a += 6;
+		b += 32;
+	}
+
+	const __m512 rows[6][2] = { { c00, c01 }, { c10, c11 }, { c20, c21 }, { c30, c31 }, { c40, c41 }, { c50, c51 } };
+	for (int r = 0; r < 6; r++)
+	{
+		float* cr = c + static_cast<size_t>(r) * ldc;
+		_mm512_storeu_ps(cr, _mm512_add_ps(_mm512_loadu_ps(cr), rows[r][0]));
+		_mm512_storeu_ps(cr + 16, _mm512_add_ps(_mm512_loadu_ps(cr + 16), rows[r][1]));
+	}
+}
+#endif
+
+// Pick the micro-kernel for element type T by name, or the widest one this
+// CPU supports for "auto"
+template <typename T>
+const MicroKernelOf<T>& selectMicroKernel(const char* name)
+{
+	const int line = 64 / sizeof(T);  // elements per 64-byte vector
+	static const MicroKernelOf<T> generic = { "generic", 4, line, microKernelGeneric<T> };
+#ifdef HAVE_X86_MICROKERNELS
+	static const MicroKernelOf<T> avx2 = { "avx2", 6, line, microKernelAvx2 };
+	static const MicroKernelOf<T> avx512 = { "avx512", 6, 2 * line, microKernelAvx512 };
+	const bool hasAvx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	const bool hasAvx512 = __builtin_cpu_supports("avx512f");
+
+	if (strcmp(name, "auto") == 0) return hasAvx512 ? avx512 : hasAvx2 ? avx2 : generic;
+	if (strcmp(name, "avx512") == 0 && hasAvx512) return avx512;
+	if (strcmp(name, "avx2") == 0 && hasAvx2) return avx2;
+#else
+	if (strcmp(name, "auto") == 0) return generic;
+#endif
+	if (strcmp(name, "generic") == 0) return generic;
+	throw invalid_argument(string("Micro-kernel not available: ") + name);
+}
+
+template <typename T>
+T* allocateAligned(size_t count)
+{
+	void* block = nullptr;
+	if (posix_memalign(&block, Matrix::alignment, max<size_t>(count, 1) * sizeof(T)) != 0)
+		throw bad_alloc();
+	return static_cast<T*>(block);
+}
+
+// First row written by thread t of an nThreads team under schedule(static)
+// without a chunk size: the first rows % nThreads threads get one extra row.
+static inline int staticRowStart(int rows, int nThreads, int t)
+{
+	return t * (rows / nThreads) + min(t, rows % nThreads);
+}
+
+// Find the node of every thread of the team and the tile rows each node
+// owns (those whose first row the static initialization partition gave to
+// one of its threads), and give every node a copy of B that its own threads
+// write, so first touch places it there
+template <typename T>
+NumaOperands<T>::NumaOperands(const BasicMatrix<T>& b, int N, int NEIB, int nThreads)
+	: nodes(topology().nodes), NEIB(NEIB), nThreads(nThreads), threadNode(nThreads), nodeRows(nodes)
+{
+	const int NB = (N + NEIB - 1) / NEIB;  // Number of blocks per dimension, counting a partial last block
+
+	#pragma omp parallel num_threads(nThreads)
+	{
+		const int tid = omp_get_thread_num();
+		threadNode[tid] = currentNode();
+
+		#pragma omp barrier
+		#pragma omp single
+		{
+			for (int p = 0; p < NB; p++)
+			{
+				// Owner of the tile row's first row in the initialization partition
+				int owner = nThreads - 1;
+				while (owner > 0 && staticRowStart(N, nThreads, owner) > p * NEIB) owner--;
+				nodeRows[threadNode[owner]].push_back(p);
+			}
+			replicas.reserve(nodes);
+			if (nodes > 1)
+				for (int node = 0; node < nodes; node++) replicas.emplace_back(N, N);
+		}
+
+		// Copy B into this node's replica, split between the node's threads
+		const int node = threadNode[tid];
+		if (nodes > 1)
+		{
+			int rank = 0, members = 0;
+			for (int t = 0; t < nThreads; t++)
+			{
+				if (threadNode[t] != node) continue;
+				if (t < tid) rank++;
+				members++;
+			}
+			BasicMatrix<T>& replica = replicas[node];
+			for (int i = staticRowStart(N, members, rank); i < staticRowStart(N, members, rank + 1); i++)
+				memcpy(replica.row(i), b.row(i), sizeof(T) * b.ld);
+		}
+	}
+}
+
+// NUMA-aware variant of the collapsed blocked kernel. With the layout found
+// by NumaOperands, the threads of each node share the tile rows of C that
+// first touch put on their node and read that node's replica of B. Tiles are
+// handed out from one counter per node, and a node that runs dry steals from
+// the others. Each thread looks up the node it runs on rather than its entry
+// in the setup's team, so a team of another size still reads local replicas.
+// Only the multiply is timed.
+const Result numaBlockedMatrixMultiplication(const Matrix& a, const Matrix& b, Matrix& c, int N, int NEIB,
+                                             int nThreads, const NumaOperands<double>& numa)
+{
+	if (numa.NEIB != NEIB) throw invalid_argument("NUMA setup was made for another block size");
+	const int NB = (N + NEIB - 1) / NEIB;  // Number of blocks per dimension, counting a partial last block
+	const Shape shape = squareShape(N);
+	const int nodes = numa.nodes;
+	double now = omp_get_wtime();
+
+	// Next tile row of each node, one cache line apart to avoid false sharing
+	vector<int> next(static_cast<size_t>(nodes) * 16, 0);
+
+	#pragma omp parallel num_threads(nThreads)
+	{
+		const int node = min(currentNode(), nodes - 1);
+		const Matrix& bLocal = nodes > 1 ? numa.replicas[node] : b;
+
+		for (int step = 0; step < nodes; step++)
+		{
+			const int victim = (node + step) % nodes;
+			const vector<int>& rows = numa.nodeRows[victim];
+			const int tiles = static_cast<int>(rows.size()) * NB;
+
+			while (true)
+			{
+				int tile;
+				#pragma omp atomic capture
+				tile = next[victim * 16]++;
+				if (tile >= tiles) break;
+
+				const int p = rows[tile / NB], q = tile % NB;
+				for (int r = 0; r < NB; r++)
+					multiplyTile(a, bLocal, c, shape, p, q, r, NEIB);
+			}
+		}
+	}
+
+	return { omp_get_wtime() - now, nThreads };
+}
+
+// Settings shared by every level of one Strassen multiply
+struct StrassenPlan
+{
+	int cutoff;
+	const PackedParams* params;
+	const MicroKernel* kernel;
+};
+
+static inline bool strassenLeaf(int n, const StrassenPlan& plan)
+{
+	return n <= plan.cutoff || n % 2 != 0;
+}
+
+// Doubles of workspace needed below a node of size n. Sequential levels reuse
+// two h x h temporaries plus the workspace of one child at a time; task
+// levels keep eight operand sums, three products and seven child
+// workspaces alive at once.
+static size_t strassenWorkspace(int n, int taskDepth, const StrassenPlan& plan)
+{
+	if (strassenLeaf(n, plan)) return 0;
+	const size_t h = n / 2;
+	if (taskDepth > 0) return 11 * h * h + 7 * strassenWorkspace(n / 2, taskDepth - 1, plan);
+	return 2 * h * h + strassenWorkspace(n / 2, 0, plan);
+}
+
+// C = A * B on the packed kernel, by the calling thread alone
+static void strassenBase(int n, const double* a, int lda, const double* b, int ldb, double* c, int ldc,
+                         const StrassenPlan& plan)
+{
+	for (int i = 0; i < n; i++) memset(c + static_cast<size_t>(i) * ldc, 0, sizeof(double) * n);
+	gemmPacked(n, n, n, a, lda, b, ldb, c, ldc, *plan.params, *plan.kernel, 1);
+}
+
+// C = X + sign * Y over an h x h block
+static void addBlocks(int h, const double* x, int ldx, const double* y, int ldy, double sign, double* c, int ldc)
+{
+	for (int i = 0; i < h; i++)
+	{
+		const double* xi = x + static_cast<size_t>(i) * ldx;
+		const double* yi = y + static_cast<size_t>(i) * ldy;
+		double* ci = c + static_cast<size_t>(i) * ldc;
+		for (int j = 0; j < h; j++) ci[j] = xi[j] + sign * yi[j];
+	}
+}
+
+// Strassen-Winograd, C = A * B, with the two-temporary schedule of Douglas et
+// al.: X and Y hold the operand sums, the quadrants of C hold the products
+// until they are combined in place.
+static void strassenSequential(int n, const double* a, int lda, const double* b, int ldb, double* c, int ldc,
+                               double* workspace, const StrassenPlan& plan)
+{
+	if (strassenLeaf(n, plan))
+	{
+		strassenBase(n, a, lda, b, ldb, c, ldc, plan);
+		return;
+	}
+
+	const int h = n / 2;
+	const double* a11 = a;
+	const double* a12 = a + h;
+	const double* a21 = a + static_cast<size_t>(h) * lda;
+	const double* a22 = a21 + h;
+	const double* b11 = b;
+	const double* b12 = b + h;
+	const double* b21 = b + static_cast<size_t>(h) * ldb;
+	const double* b22 = b21 + h;
+	double* c11 = c;
+	double* c12 = c + h;
+	double* c21 = c + static_cast<size_t>(h) * ldc;
+	double* c22 = c21 + h;
+	double* x = workspace;
+	double* y = x + static_cast<size_t>(h) * h;
+	double* child = y + static_cast<size_t>(h) * h;
+
+	addBlocks(h, a11, lda, a21, lda, -1.0, x, h);                  // X = S3 = A11 - A21
+	addBlocks(h, b22, ldb, b12, ldb, -1.0, y, h);                  // Y = T3 = B22 - B12
+	strassenSequential(h, x, h, y, h, c21, ldc, child, plan);      // C21 = P7 = S3 T3
+	addBlocks(h, a21, lda, a22, lda, 1.0, x, h);                   // X = S1 = A21 + A22
+	addBlocks(h, b12, ldb, b11, ldb, -1.0, y, h);                  // Y = T1 = B12 - B11
+	strassenSequential(h, x, h, y, h, c22, ldc, child, plan);      // C22 = P5 = S1 T1
+	addBlocks(h, x, h, a11, lda, -1.0, x, h);                      // X = S2 = S1 - A11
+	addBlocks(h, b22, ldb, y, h, -1.0, y, h);                      // Y = T2 = B22 - T1
+	strassenSequential(h, x, h, y, h, c12, ldc, child, plan);      // C12 = P6 = S2 T2
+	addBlocks(h, a12, lda, x, h, -1.0, x, h);                      // X = S4 = A12 - S2
+	strassenSequential(h, x, h, b22, ldb, c11, ldc, child, plan);  // C11 = P3 = S4 B22
+	strassenSequential(h, a11, lda, b11, ldb, x, h, child, plan);  // X = P1 = A11 B11
+	addBlocks(h, x, h, c12, ldc, 1.0, c12, ldc);                   // C12 = U2 = P1 + P6
+	addBlocks(h, c12, ldc, c21, ldc, 1.0, c21, ldc);               // C21 = U3 = U2 + P7
+	addBlocks(h, c12, ldc, c22, ldc, 1.0, c12, ldc);               // C12 = U4 = U2 + P5
+	addBlocks(h, c21, ldc, c22, ldc, 1.0, c22, ldc);               // C22 = U7 = U3 + P5
+	addBlocks(h, c12, ldc, c11, ldc, 1.0, c12, ldc);               // C12 = U5 = U4 + P3
+	addBlocks(h, y, h, b21, ldb, -1.0, y, h);                      // Y = T4 = T2 - B21
+	strassenSequential(h, a22, lda, y, h, c11, ldc, child, plan);  // C11 = P4 = A22 T4
+	addBlocks(h, c21, ldc, c11, ldc, -1.0, c21, ldc);              // C21 = U6 = U3 - P4
+	strassenSequential(h, a12, lda, b21, ldb, c11, ldc, child, plan);  // C11 = P2 = A12 B21
+	addBlocks(h, c11, ldc, x, h, 1.0, c11, ldc);                   // C11 = U1 = P1 + P2
+}
+
+// Task-parallel level: the eight operand sums are formed by a taskloop, the
+// seven products run as sibling tasks (P3, P5, P6, P7 straight into the
+// quadrants of C), and one fused taskloop combines them after the taskwait.
+// Called from inside a single construct of the enclosing parallel region.
+static void strassenTasks(int n, const double* a, int lda, const double* b, int ldb, double* c, int ldc,
+                          double* workspace, int taskDepth, const StrassenPlan& plan)
+{
+	if (strassenLeaf(n, plan))
+	{
+		strassenBase(n, a, lda, b, ldb, c, ldc, plan);
+		return;
+	}
+	if (taskDepth == 0)
+	{
+		strassenSequential(n, a, lda, b, ldb, c, ldc, workspace, plan);
+		return;
+	}
+
+	const int h = n / 2;
+	const size_t hh = static_cast<size_t>(h) * h;
+	const double* a11 = a;
+	const double* a12 = a + h;
+	const double* a21 = a + static_cast<size_t>(h) * lda;
+	const double* a22 = a21 + h;
+	const double* b11 = b;
+	const double* b12 = b + h;
+	const double* b21 = b + static_cast<size_t>(h) * ldb;
+	const double* b22 = b21 + h;
+	double* c11 = c;
+	double* c12 = c + h;
+	double* c21 = c + static_cast<size_t>(h) * ldc;
+	double* c22 = c21 + h;
+
+	double* s1 = workspace;
+	double* s2 = s1 + hh;
+	double* s3 = s2 + hh;
+	double* s4 = s3 + hh;
+	double* t1 = s4 + hh;
+	double* t2 = t1 + hh;
+	double* t3 = t2 + hh;
+	double* t4 = t3 + hh;
+	double* p1 = t4 + hh;
+	double* p2 = p1 + hh;
+	double* p4 = p2 + hh;
+	double* child = p4 + hh;
+	const size_t childSize = strassenWorkspace(h, taskDepth - 1, plan);
+
+	#pragma omp taskloop grainsize(16)
+	for (int i = 0; i < h; i++)
+	{
+		const size_t ra = static_cast<size_t>(i) * lda, rb = static_cast<size_t>(i) * ldb, rt = static_cast<size_t>(i) * h;
+		for (int j = 0; j < h; j++)
+		{
+			const double sum1 = a21[ra + j] + a22[ra + j];
+			const double sum2 = sum1 - a11[ra + j];
+			s1[rt + j] = sum1;
+			s2[rt + j] = sum2;
+			s3[rt + j] = a11[ra + j] - a21[ra + j];
+			s4[rt + j] = a12[ra + j] - sum2;
+
+			const double diff1 = b12[rb + j] - b11[rb + j];
+			const double diff2 = b22[rb + j] - diff1;
+			t1[rt + j] = diff1;
+			t2[rt + j] = diff2;
+			t3[rt + j] = b22[rb + j] - b12[rb + j];
+			t4[rt + j] = diff2 - b21[rb + j];
+		}
+	}
+
+	#pragma omp task
+	strassenTasks(h, a11, lda, b11, ldb, p1, h, child + 0 * childSize, taskDepth - 1, plan);
+	#pragma omp task
+	strassenTasks(h, a12, lda, b21, ldb, p2, h, child + 1 * childSize, taskDepth - 1, plan);
+	#pragma omp task
+	strassenTasks(h, s4, h, b22, ldb, c11, ldc, child + 2 * childSize, taskDepth - 1, plan);
+	#pragma omp task
+	strassenTasks(h, a22, lda, t4, h, p4, h, child + 3 * childSize, taskDepth - 1, plan);
+	#pragma omp task
+	strassenTasks(h, s1, h, t1, h, c22, ldc, child + 4 * childSize, taskDepth - 1, plan);
+	#pragma omp task
+	strassenTasks(h, s2, h, t2, h, c12, ldc, child + 5 * childSize, taskDepth - 1, plan);
+	#pragma omp task
+	strassenTasks(h, s3, h, t3, h, c21, ldc, child + 6 * childSize, taskDepth - 1, plan);
+	#pragma omp taskwait
+
+	#pragma omp taskloop grainsize(16)
+	for (int i = 0; i < h; i++)
+	{
+		const size_t rc = static_cast<size_t>(i) * ldc, rt = static_cast<size_t>(i) * h;
+		for (int j = 0; j < h; j++)
+		{
+			const double u2 = p1[rt + j] + c12[rc + j];  // P1 + P6
+			const double u3 = u2 + c21[rc + j];          // + P7
+			const double p5 = c22[rc + j];
+			c12[rc + j] = u2 + p5 + c11[rc + j];         // U5 = U2 + P5 + P3
+			c11[rc + j] = p1[rt + j] + p2[rt + j];       // U1
+			c21[rc + j] = u3 - p4[rt + j];               // U6
+			c22[rc + j] = u3 + p5;                       // U7
+		}
+	}
+}
+
+// Strassen-Winograd multiply: 7 half-size products per level instead of 8,
+// so O(N^2.81) work. The top taskDepth levels spawn their products as OpenMP
+// tasks, deeper levels recurse sequentially inside each task, and blocks of
+// at most cutoff (or of odd size) go to the packed kernel. All temporaries
+// come from one workspace arena sized up front and kept between calls.
+// Unlike the other kernels, c is overwritten rather than accumulated into.
+const Result strassenMatrixMultiplication(const Matrix& a, const Matrix& b, Matrix& c, int N, int nThreads,
+                                          int cutoff, int taskDepth, const PackedParams& params,
+                                          const MicroKernel& kernel)
+{
+	static ScratchBuffer arena;
+	const StrassenPlan plan = { max(cutoff, 16), &params, &kernel };
+
+	if (taskDepth <= 0)
+		for (int spawned = 1; spawned < nThreads; spawned *= 7) taskDepth++;
+
+	double* workspace = arena.reserve(strassenWorkspace(N, taskDepth, plan));
+	double now = omp_get_wtime();
+
+	if (strassenLeaf(N, plan))
+	{
+		c.fill(0.0, nThreads);
+		gemmPacked(N, N, N, a.data, a.ld, b.data, b.ld, c.data, c.ld, params, kernel, nThreads);
+	}
+	else
+	{
+		#pragma omp parallel num_threads(nThreads)
+		#pragma omp single
+		strassenTasks(N, a.data, a.ld, b.data, b.ld, c.data, c.ld, workspace, taskDepth, plan);
+	}
+
+	return { omp_get_wtime() - now, nThreads };
+}
+
+// Nonzero elements of op(A), counted row by row without a branch, which a
+// random sparsity pattern would mispredict
+size_t countNonzeros(const Matrix& a, const Shape& shape, int nThreads)
+{
+	const Strides sa = Strides::of(a.ld, shape.transposeA);
+	size_t count = 0;
+
+	#pragma omp parallel for schedule(static) num_threads(nThreads) reduction(+:count)
+	for (int i = 0; i < shape.m; i++)
+		for (int k = 0; k < shape.k; k++)
+			count += a.data[i * sa.row + k * sa.col] != 0.0;
+	return count;
+}
+
+// Two passes over op(A): count each row's nonzeros, then, after a prefix sum
+// gives every row its offset, copy them out. Both passes split the same rows.
+CsrMatrix CsrMatrix::fromDense(const Matrix& a, const Shape& shape, int nThreads)
+{
+	const Strides sa = Strides::of(a.ld, shape.transposeA);
+	CsrMatrix csr;
+	csr.rows = shape.m;
+	csr.cols = shape.k;
+	csr.rowStart.assign(static_cast<size_t>(shape.m) + 1, 0);
+
+	#pragma omp parallel for schedule(static) num_threads(nThreads)
+	for (int i = 0; i < shape.m; i++)
+	{
+		size_t count = 0;
+		for (int k = 0; k < shape.k; k++)
+			count += a.data[i * sa.row + k * sa.col] != 0.0;
+		csr.rowStart[i + 1] = count;
+	}
+	for (int i = 0; i < shape.m; i++) csr.rowStart[i + 1] += csr.rowStart[i];
+
+	csr.column.resize(csr.rowStart[shape.m]);
+	csr.values.resize(csr.rowStart[shape.m]);
+	#pragma omp parallel for schedule(static) num_threads(nThreads)
+	for (int i = 0; i < shape.m; i++)
+	{
+		size_t e = csr.rowStart[i];
+		for (int k = 0; k < shape.k; k++)
+		{
+			const double value = a.data[i * sa.row + k * sa.col];
+			if (value == 0.0) continue;
+			csr.column[e] = k;
+			csr.values[e++] = value;
+		}
+	}
+	return csr;
+}
+
+// C += A * op(B) for CSR A in O(nnz * N): each nonzero A(i, k) adds a scaled
+// row k of op(B) to row i of C. Rows are split into one contiguous range per
+// thread holding an equal share of the nonzeros (nnz-weighted static
+// partitioning), so a few dense rows do not leave the rest of the team idle.
+// A single row is never split, which would need a reduction into C.
+const Result sparseMatrixMultiplication(const CsrMatrix& a, const Matrix& b, Matrix& c, const Shape& shape,
+                                        int nThreads)
+{
+	const Strides sb = Strides::of(b.ld, shape.transposeB);
+	const size_t nnz = a.nonzeros();
+	double now = omp_get_wtime();
+
+	tracer.begin("sparse", nThreads);
+	#pragma omp parallel num_threads(nThreads)
+	{
+		const int t = omp_get_thread_num(), team = omp_get_num_threads();
+		// First row starting at or after this thread's first nonzero, and the next thread's
+		const size_t* rowStart = a.rowStart.data();
+		const int first = lower_bound(rowStart, rowStart + a.rows, nnz * t / team) - rowStart;
+		const int last = t + 1 == team ? a.rows : lower_bound(rowStart, rowStart + a.rows, nnz * (t + 1) / team) - rowStart;
+
+		for (int i = first; i < last; i++)
+		{
+			TracedIteration traced;
+			double* ci = c.row(i);
+			for (size_t e = a.rowStart[i]; e < a.rowStart[i + 1]; e++)
+			{
+				const double aik = a.values[e];
+				const double* bk = b.data + a.column[e] * sb.row;
+				if (sb.col == 1)
+				{
+					#pragma omp simd
+					for (int j = 0; j < shape.n; j++) ci[j] += aik * bk[j];
+				}
+				else
+				{
+					for (int j = 0; j < shape.n; j++) ci[j] += aik * bk[j * sb.col];
+				}
+			}
+		}
+	}
+	tracer.end();
+
+	return { omp_get_wtime() - now, nThreads };
+}
+
+// Method 8: A arrives dense, so the time includes finding its nonzeros. At
+// or below --sparse-threshold op(A) is converted to CSR and multiplied in
+// O(nnz * N); denser operands go to the packed kernel, which wins there.
+const Result sparseOrDenseMatrixMultiplication(const Matrix& a, const Matrix& b, Matrix& c, const Shape& shape,
+                                               int nThreads, const Options& options)
+{
+	double now = omp_get_wtime();
+
+	const size_t nnz = countNonzeros(a, shape, nThreads);
+	if (static_cast<double>(nnz) > options.sparseThreshold * shape.m * shape.k)
+		gemmPacked(shape.m, shape.n, shape.k, a.data, a.ld, b.data, b.ld, c.data, c.ld, options.packed,
+		           selectMicroKernel(options.kernel), nThreads, shape.transposeA, shape.transposeB);
+	else
+		sparseMatrixMultiplication(CsrMatrix::fromDense(a, shape, nThreads), b, c, shape, nThreads);
+
+	return { omp_get_wtime() - now, nThreads };
+}
+
+double* ScratchBuffer::reserve(size_t count)
+{
+	if (count > capacity)
+	{
+		free(data);
+		data = nullptr;
+		data = allocateAligned(count);
+		capacity = count;
+	}
+	return data;
+}
+
+ScratchBuffer::~ScratchBuffer()
+{
+	free(data);
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(int rows, int cols)
+	: rows(rows), cols(cols), data(nullptr)
+{
+	const int perLine = alignment / sizeof(T);
+	ld = (cols + perLine - 1) / perLine * perLine;
+	data = allocateAligned<T>(static_cast<size_t>(rows) * ld);
+}
+
+// Shared matrices are page aligned by mmap; the object is created fresh, so
+// a stale one of the same name is replaced
+template <>
+Matrix::BasicMatrix(int rows, int cols, const string& name)
+	: rows(rows), cols(cols), data(nullptr), sharedName(name)
+{
+	const int perLine = alignment / sizeof(double);
+	ld = (cols + perLine - 1) / perLine * perLine;
+	mappedBytes = max<size_t>(static_cast<size_t>(rows) * ld * sizeof(double), 1);
+
+	shm_unlink(name.c_str());
+	const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) throw runtime_error("Cannot create shared memory " + name + ": " + strerror(errno));
+	void* mapping = MAP_FAILED;
+	if (ftruncate(fd, static_cast<off_t>(mappedBytes)) == 0)
+		mapping = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		shm_unlink(name.c_str());
+		throw runtime_error("Cannot map shared memory " + name + ": " + strerror(errno));
+	}
+	data = static_cast<double*>(mapping);
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(BasicMatrix&& other)
+	: rows(other.rows), cols(other.cols), ld(other.ld), data(other.data), mappedBytes(other.mappedBytes),
+	  mappedOffset(other.mappedOffset), sharedName(move(other.sharedName))
+{
+	other.data = nullptr;
+	other.mappedBytes = other.mappedOffset = 0;
+	other.sharedName.clear();
+}
+
+template <typename T>
+BasicMatrix<T>::~BasicMatrix()
+{
+	if (mappedBytes && data) munmap(reinterpret_cast<char*>(data) - mappedOffset, mappedBytes);
+	else free(data);
+	if (!sharedName.empty()) shm_unlink(sharedName.c_str());
+}
+
+// Why a matrix file of the given size cannot be used, or nullptr if it can
+const char* matrixFileProblem(const MatrixFileHeader& header, uint64_t bytes)
+{
+	const uint64_t maxExtent = numeric_limits<int>::max();
+	if (memcmp(header.magic, matrixFileMagic, sizeof(matrixFileMagic)) != 0) return "not a matrix file";
+	if (header.byteOrder != matrixFileByteOrder) return "written with another byte order";
+	if (header.dtype != matrixFileDouble) return "element type is not double";
+	if (header.rows == 0 || header.cols == 0 || header.ld < header.cols || header.rows > maxExtent ||
+	    header.ld > maxExtent)
+		return "bad dimensions";
+	if (header.alignment < sizeof(double) || header.dataOffset < sizeof(MatrixFileHeader) ||
+	    header.dataOffset % header.alignment != 0 || header.ld * sizeof(double) % header.alignment != 0 ||
+	    header.dataOffset % sizeof(double) != 0)
+		return "bad alignment";
+	if (bytes < header.dataOffset || (bytes - header.dataOffset) / sizeof(double) / header.ld < header.rows)
+		return "file is shorter than its header says";
+	return nullptr;
+}
+
+// Header of a new file with rows padded to whole cache lines, like heap matrices
+MatrixFileHeader matrixFileHeader(int rows, int cols)
+{
+	const int perLine = Matrix::alignment / sizeof(double);
+	MatrixFileHeader header = {};
+	memcpy(header.magic, matrixFileMagic, sizeof(matrixFileMagic));
+	header.byteOrder = matrixFileByteOrder;
+	header.dtype = matrixFileDouble;
+	header.rows = rows;
+	header.cols = cols;
+	header.ld = (cols + perLine - 1) / perLine * perLine;
+	header.alignment = Matrix::alignment;
+	header.dataOffset = sizeof(MatrixFileHeader);
+	return header;
+}
+
+// Private mapping: the kernels never write A or B, and a stray write would
+// stay in this process instead of changing the file
+template <>
+Matrix Matrix::load(const char* path)
+{
+	const int fd = open(path, O_RDONLY);
+	struct stat info;
+	if (fd < 0 || fstat(fd, &info) != 0)
+	{
+		if (fd >= 0) close(fd);
+		throw runtime_error(string("Cannot open matrix file ") + path + ": " + strerror(errno));
+	}
+	const uint64_t bytes = static_cast<uint64_t>(info.st_size);
+	void* mapping = bytes >= sizeof(MatrixFileHeader)
+		? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (mapping == MAP_FAILED) throw runtime_error(string("Cannot map matrix file ") + path);
+
+	Matrix matrix;
+	matrix.mappedBytes = bytes;
+	const MatrixFileHeader& header = *static_cast<const MatrixFileHeader*>(mapping);
+	if (const char* problem = matrixFileProblem(header, bytes))
+	{
+		munmap(mapping, bytes);
+		throw runtime_error(string("Cannot load matrix file ") + path + ": " + problem);
+	}
+
+	matrix.rows = static_cast<int>(header.rows);
+	matrix.cols = static_cast<int>(header.cols);
+	matrix.ld = static_cast<int>(header.ld);
+	matrix.mappedOffset = header.dataOffset;
+	matrix.data = reinterpret_cast<double*>(static_cast<char*>(mapping) + header.dataOffset);
+	return matrix;
+}
+
+// The file is sized up front, so the untouched tail stays sparse until the
+// product is written
+template <>
+Matrix Matrix::create(const char* path, int rows, int cols)
+{
+	const MatrixFileHeader header = matrixFileHeader(rows, cols);
+	const int padded = static_cast<int>(header.ld);
+	const size_t offset = header.dataOffset;
+	const size_t bytes = offset + static_cast<size_t>(rows) * padded * sizeof(double);
+
+	const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) throw runtime_error(string("Cannot create matrix file ") + path + ": " + strerror(errno));
+	void* mapping = MAP_FAILED;
+	if (ftruncate(fd, static_cast<off_t>(bytes)) == 0)
+		mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED)
+		throw runtime_error(string("Cannot map matrix file ") + path + ": " + strerror(errno));
+
+	memcpy(mapping, &header, sizeof(header));
+
+	Matrix matrix;
+	matrix.rows = rows;
+	matrix.cols = cols;
+	matrix.ld = padded;
+	matrix.mappedBytes = bytes;
+	matrix.mappedOffset = offset;
+	matrix.data = reinterpret_cast<double*>(static_cast<char*>(mapping) + offset);
+	return matrix;
+}
+
+// A batch operand: mapped from load, created in store, or on the heap
+Matrix operandMatrix(const char* load, const char* store, int rows, int cols)
+{
+	if (!load) return store ? Matrix::create(store, rows, cols) : Matrix(rows, cols);
+	Matrix matrix = Matrix::load(load);
+	if (matrix.rows != rows || matrix.cols != cols)
+		throw runtime_error(string("Matrix file ") + load + " is " + to_string(matrix.rows) + " x " +
+		                    to_string(matrix.cols) + ", expected " + to_string(rows) + " x " + to_string(cols));
+	return matrix;
+}
+
+// One operand or product file of the out-of-core multiply, read and written
+// with pread/pwrite
+struct TileFile
+{
+	int fd = -1;
+	MatrixFileHeader header;
+
+	TileFile(const char* path, bool create, int N);
+	~TileFile() { if (fd >= 0) close(fd); }
+
+	// Rows [i0, i0 + rows) and columns [j0, j0 + cols) to or from buffer with leading dimension ld
+	void read(int i0, int j0, int rows, int cols, double* buffer, int ld) const;
+	void write(int i0, int j0, int rows, int cols, const double* buffer, int ld) const;
+
+	TileFile(const TileFile&) = delete;
+	TileFile& operator=(const TileFile&) = delete;
+};
+
+TileFile::TileFile(const char* path, bool create, int N)
+{
+	fd = open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+	if (fd < 0) throw runtime_error(string("Cannot open matrix file ") + path + ": " + strerror(errno));
+	if (create)
+	{
+		header = matrixFileHeader(N, N);
+		const off_t bytes = static_cast<off_t>(header.dataOffset + header.rows * header.ld * sizeof(double));
+		if (ftruncate(fd, bytes) != 0 || pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+			throw runtime_error(string("Cannot write matrix file ") + path + ": " + strerror(errno));
+		return;
+	}
+
+	struct stat info;
+	const char* problem = fstat(fd, &info) != 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+		? "cannot read the header" : matrixFileProblem(header, static_cast<uint64_t>(info.st_size));
+	if (!problem && (header.rows != static_cast<uint64_t>(N) || header.cols != static_cast<uint64_t>(N)))
+		problem = "size differs from N";
+	if (problem) throw runtime_error(string("Cannot load matrix file ") + path + ": " + problem);
+}
+
+void TileFile::read(int i0, int j0, int rows, int cols, double* buffer, int ld) const
+{
+	const size_t bytes = sizeof(double) * cols;
+	for (int i = 0; i < rows; i++)
+	{
+		const off_t at = static_cast<off_t>(header.dataOffset + ((i0 + i) * header.ld + j0) * sizeof(double));
+		char* target = reinterpret_cast<char*>(buffer + static_cast<size_t>(i) * ld);
+		for (size_t done = 0; done < bytes; )
+		{
+			const ssize_t count = pread(fd, target + done, bytes - done, at + done);
+			if (count <= 0) throw runtime_error(string("Short read from a matrix file: ") + strerror(errno));
+			done += count;
+		}
+	}
+}
+
+void TileFile::write(int i0, int j0, int rows, int cols, const double* buffer, int ld) const
+{
+	const size_t bytes = sizeof(double) * cols;
+	for (int i = 0; i < rows; i++)
+	{
+		const off_t at = static_cast<off_t>(header.dataOffset + ((i0 + i) * header.ld + j0) * sizeof(double));
+		const char* source = reinterpret_cast<const char*>(buffer + static_cast<size_t>(i) * ld);
+		for (size_t done = 0; done < bytes; )
+		{
+			const ssize_t count = pwrite(fd, source + done, bytes - done, at + done);
+			if (count <= 0) throw runtime_error(string("Short write to a matrix file: ") + strerror(errno));
+			done += count;
+		}
+	}
+}
+
+// Bounded pool of tile buffers fed by one I/O thread. The compute thread
+// prefetches the tiles of its next step, blocks in acquire only while a read
+// is still in flight, and hands finished C tiles to writeBack, so disk traffic
+// overlaps the kernel. Tiles in use are pinned; a new read recycles the least
+// recently used unpinned tile, keeping the A panel being swept (keepPanel)
+// until nothing else is left, since it is reused for every tile of C in the row.
+struct TileCache
+{
+	struct Slot
+	{
+		double* data = nullptr;
+		int matrix = -1, i = -1, j = -1;  // matrix 0 = A, 1 = B, 2 = a C tile being written back
+		bool ready = false;
+		int pins = 0;
+		long long lastUse = 0;
+	};
+
+	const TileFile* files[3];
+	int N, tile, ld;
+	vector<Slot> slots;   // A/B tiles first, then the two C buffers
+	deque<int> queue;     // slots for the I/O thread to read or write
+	mutex lock;
+	condition_variable changed;
+	long long clock = 0;
+	int keepPanel = -1;
+	bool stopping = false;
+	string failure;
+	OutOfCoreStats& stats;
+	thread io;
+
+	TileCache(const TileFile* files[3], int N, int tile, int capacity, OutOfCoreStats& stats);
+	~TileCache();
+
+	const double* acquire(int matrix, int i, int j);
+	void release(int matrix, int i, int j);
+	void prefetch(int matrix, int i, int j);
+	double* product(int buffer);            // wait until C buffer 0 or 1 is free again
+	void writeBack(int buffer, int i, int j);
+	void flush();                           // wait for every write
+	int extent(int t) const { return min(tile, N - t * tile); }
+
+private:
+	int find(int matrix, int i, int j) const;
+	int request(int matrix, int i, int j);  // call with lock held; -1 if every slot is pinned
+	void wait(unique_lock<mutex>& held);
+	void check() const;  // call with lock held; rethrows an I/O thread failure
+	void run();
+};
+
+TileCache::TileCache(const TileFile* files[3], int N, int tile, int capacity, OutOfCoreStats& stats)
+	: N(N), tile(tile), ld((tile + 7) / 8 * 8), slots(capacity + 2), stats(stats)
+{
+	for (int k = 0; k < 3; k++) this->files[k] = files[k];
+	for (Slot& slot : slots) slot.data = allocateAligned(static_cast<size_t>(tile) * ld);
+	slots[capacity].ready = slots[capacity + 1].ready = true;  // C buffers start free
+	stats.cachedTiles = capacity;
+	io = thread(&TileCache::run, this);
+}
+
+TileCache::~TileCache()
+{
+	{
+		lock_guard<mutex> held(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	io.join();
+	for (Slot& slot : slots) free(slot.data);
+}
+
+int TileCache::find(int matrix, int i, int j) const
+{
+	for (size_t s = 0; s + 2 < slots.size(); s++)
+		if (slots[s].matrix == matrix && slots[s].i == i && slots[s].j == j) return static_cast<int>(s);
+	return -1;
+}
+
+int TileCache::request(int matrix, int i, int j)
+{
+	int victim = -1;
+	for (size_t s = 0; s + 2 < slots.size(); s++)
+	{
+		const Slot& slot = slots[s];
+		if (slot.pins > 0 || (slot.matrix >= 0 && !slot.ready)) continue;
+		const bool kept = slot.matrix == 0 && slot.i == keepPanel;
+		if (victim < 0) { victim = static_cast<int>(s); continue; }
+		const Slot& best = slots[victim];
+		const bool bestKept = best.matrix == 0 && best.i == keepPanel;
+		if (kept != bestKept ? !kept : slot.lastUse < best.lastUse) victim = static_cast<int>(s);
+	}
+	if (victim < 0) return -1;
+
+	Slot& slot = slots[victim];
+	slot.matrix = matrix;
+	slot.i = i;
+	slot.j = j;
+	slot.ready = false;
+	slot.lastUse = ++clock;
+	queue.push_back(victim);
+	changed.notify_all();
+	return victim;
+}
+
+void TileCache::check() const
+{
+	if (!failure.empty()) throw runtime_error(failure);
+}
+
+void TileCache::wait(unique_lock<mutex>& held)
+{
+	check();
+	const double start = omp_get_wtime();
+	changed.wait(held);
+	stats.ioWait += omp_get_wtime() - start;
+	check();
+}
+
+void TileCache::prefetch(int matrix, int i, int j)
+{
+	lock_guard<mutex> held(lock);
+	if (find(matrix, i, j) < 0) request(matrix, i, j);
+}
+
+const double* TileCache::acquire(int matrix, int i, int j)
+{
+	unique_lock<mutex> held(lock);
+	check();
+	int s = find(matrix, i, j);
+	if (s >= 0) stats.hits++;
+	else stats.misses++;
+	while (true)
+	{
+		if (s < 0) s = request(matrix, i, j);
+		if (s >= 0 && slots[s].ready) break;
+		wait(held);
+		s = find(matrix, i, j);
+	}
+	slots[s].pins++;
+	slots[s].lastUse = ++clock;
+	return slots[s].data;
+}
+
+void TileCache::release(int matrix, int i, int j)
+{
+	{
+		lock_guard<mutex> held(lock);
+		slots[find(matrix, i, j)].pins--;
+	}
+	changed.notify_all();
+}
+
+double* TileCache::product(int buffer)
+{
+	unique_lock<mutex> held(lock);
+	check();
+	Slot& slot = slots[slots.size() - 2 + buffer];
+	while (!slot.ready) wait(held);
+	return slot.data;
+}
+
+void TileCache::writeBack(int buffer, int i, int j)
+{
+	{
+		lock_guard<mutex> held(lock);
+		const int s = static_cast<int>(slots.size()) - 2 + buffer;
+		slots[s].matrix = 2;
+		slots[s].i = i;
+		slots[s].j = j;
+		slots[s].ready = false;
+		queue.push_back(s);
+	}
+	changed.notify_all();
+}
+
+void TileCache::flush()
+{
+	{
+		lock_guard<mutex> held(lock);
+		check();
+	}
+	for (int buffer = 0; buffer < 2; buffer++) product(buffer);
+}
+
+// The I/O thread: reads into A/B slots and writes C buffers in request order,
+// without the lock held during the transfer
+void TileCache::run()
+{
+	unique_lock<mutex> held(lock);
+	while (true)
+	{
+		while (queue.empty() && !stopping) changed.wait(held);
+		if (queue.empty()) return;
+		const int s = queue.front();
+		queue.pop_front();
+		Slot& slot = slots[s];
+		const int matrix = slot.matrix, i = slot.i, j = slot.j;
+		const int rows = extent(i), cols = extent(j);
+		held.unlock();
+
+		string error;
+		try
+		{
+			if (matrix == 2) files[2]->write(i * tile, j * tile, rows, cols, slot.data, ld);
+			else files[matrix]->read(i * tile, j * tile, rows, cols, slot.data, ld);
+		}
+		catch (exception& e)
+		{
+			error = e.what();
+		}
+
+		held.lock();
+		if (!error.empty())
+		{
+			// The slot holds no valid tile: nothing may find it, and waiters rethrow
+			failure = error;
+			slot.matrix = -1;
+		}
+		else
+		{
+			(matrix == 2 ? stats.writtenBytes : stats.readBytes) += sizeof(double) * rows * cols;
+			slot.ready = true;
+		}
+		changed.notify_all();
+	}
+}
+
+// C = A * B for N x N matrix files too large for memory, in tile x tile
+// blocks: every C tile accumulates the products of its row panel of A and
+// column panel of B, tile by tile, with the packed kernel and the whole team.
+// Only the tile cache (--tile-memory) and two C tiles are resident; the I/O
+// thread reads one step ahead and writes each finished C tile behind the
+// kernel, so with enough arithmetic per tile (it grows with the tile size) the
+// disk stays out of the critical path.
+const Result outOfCoreMatrixMultiplication(const char* aPath, const char* bPath, const char* cPath, int N, int tile,
+                                           int nThreads, const Options& options, OutOfCoreStats& stats)
+{
+	double now = omp_get_wtime();
+
+	const TileFile a(aPath, false, N), b(bPath, false, N), c(cPath, true, N);
+	const TileFile* files[3] = { &a, &b, &c };
+	tile = min(tile, N);
+	const size_t tileBytes = sizeof(double) * tile * ((tile + 7) / 8 * 8);
+	const int tiles = (N + tile - 1) / tile;
+	// Two pinned operands and their prefetched successors at the least, every A and B tile at the most,
+	// plus the two C tiles; a budget below the least is an error rather than silently exceeded
+	const size_t budget = static_cast<size_t>(options.tileMemory) * 1048576 / tileBytes;
+	const size_t all = 2 * static_cast<size_t>(tiles) * tiles;
+	const size_t least = min<size_t>(all, 4) + 2;
+	if (budget < least)
+		throw invalid_argument("--tile-memory=" + to_string(options.tileMemory) + " holds fewer than the " +
+		                       to_string(least) + " tiles out-of-core needs; use at least " +
+		                       to_string((least * tileBytes + 1048575) / 1048576) + " MiB or a smaller tile");
+	const int capacity = static_cast<int>(min(all, budget - 2));
+	TileCache cache(files, N, tile, capacity, stats);
+	const MicroKernel& kernel = selectMicroKernel(options.kernel);
+
+	int buffer = 0;
+	for (int i = 0; i < tiles; i++)
+	{
+		cache.keepPanel = i;
+		for (int j = 0; j < tiles; j++, buffer ^= 1)
+		{
+			double* product = cache.product(buffer);
+			const int rows = cache.extent(i), cols = cache.extent(j);
+			for (int r = 0; r < rows; r++)
+			{
+				double* row = product + static_cast<size_t>(r) * cache.ld;
+				fill(row, row + cols, 0.0);
+			}
+
+			for (int k = 0; k < tiles; k++)
+			{
+				// Next step: the following k, or the first k of the next C tile
+				const int nextI = k + 1 < tiles ? i : (j + 1 < tiles ? i : i + 1);
+				const int nextJ = k + 1 < tiles ? j : (j + 1 < tiles ? j + 1 : 0);
+				const int nextK = k + 1 < tiles ? k + 1 : 0;
+				const double* aTile = cache.acquire(0, i, k);
+				const double* bTile = cache.acquire(1, k, j);
+				if (nextI < tiles)
+				{
+					cache.prefetch(0, nextI, nextK);
+					cache.prefetch(1, nextK, nextJ);
+				}
+
+				gemmPacked(rows, cols, cache.extent(k), aTile, cache.ld, bTile, cache.ld, product, cache.ld,
+				           options.packed, kernel, nThreads);
+				cache.release(0, i, k);
+				cache.release(1, k, j);
+			}
+			cache.writeBack(buffer, i, j);
+		}
+	}
+	cache.flush();
+
+	return { omp_get_wtime() - now, nThreads };
+}
+
+// Method 7 in batch mode: --load-a and --load-b name the operands and
+// --store-c the product. Prints the usual CSV line (or the benchmark report
+// with the I/O counters of the last run) and checks C with --verify.
+int runOutOfCore(int N, int tile, int nThreads, const Options& options)
+{
+	if (!options.load[0] || !options.load[1] || !options.store[2])
+		throw invalid_argument("The out-of-core method needs --load-a, --load-b and --store-c");
+
+	omp_set_schedule(options.schedule.kind, options.schedule.chunk);
+	OutOfCoreStats stats;
+	vector<double> times;
+	for (int run = 0; run < (options.reps > 0 ? options.warmup + options.reps : 1); run++)
+	{
+		stats = OutOfCoreStats();
+		const Result result = outOfCoreMatrixMultiplication(options.load[0], options.load[1], options.store[2], N,
+		                                                    tile, nThreads, options, stats);
+		if (options.reps == 0 || run >= options.warmup) times.push_back(result.timestamp);
+	}
+	cerr << "Out-of-core: " << stats.cachedTiles << " cached tiles, read " << setprecision(1) << fixed
+	     << stats.readBytes / 1048576 << " MiB, wrote " << stats.writtenBytes / 1048576 << " MiB, "
+	     << stats.hits << " hits, " << stats.misses << " misses, " << setprecision(6) << stats.ioWait
+	     << " s waiting for I/O" << endl;
+
+	bool verified = true;
+	if (options.verify)
+	{
+		const Matrix a = Matrix::load(options.load[0]), b = Matrix::load(options.load[1]);
+		const Matrix c = Matrix::load(options.store[2]);
+		verified = reportVerification(verifyResult(a, b, c, squareShape(N), options, nThreads), 7, options.tolerance);
+	}
+
+	if (options.reps == 0)
+	{
+		cout << 7 << "," << nThreads << "," << fixed << setprecision(8) << times[0] << endl;
+		return verified ? 0 : 2;
+	}
+
+	const Statistics summary = summarize(times);
+	vector<ReportField> report = {
+		field("method", 7), field("threads", nThreads), field("n", N), field("neib", tile),
+		field("warmup", options.warmup), field("reps", options.reps),
+		field("min", summary.min), field("median", summary.median), field("p95", summary.p95),
+		field("mean", summary.mean), field("stddev", summary.stddev),
+		field("gflops", 2.0 * N * N * N / summary.median * 1e-9),
+		field("schedule", string(scheduleName(options.schedule))), field("chunk", options.schedule.chunk),
+		field("read_mib", stats.readBytes / 1048576), field("written_mib", stats.writtenBytes / 1048576),
+		field("io_wait", stats.ioWait), field("cached_tiles", stats.cachedTiles)
+	};
+	if (options.verify) report.push_back(field("verified", string(verified ? "pass" : "fail")));
+	printReport(cout, report, options.format);
+	return verified ? 0 : 2;
+}
+
+// First element of part index when extent is cut into parts contiguous
+// slices whose sizes differ by at most one
+int partStart(int extent, int parts, int index)
+{
+	return static_cast<int>(static_cast<long long>(extent) * index / parts);
+}
+
+#ifdef HAVE_MPI
+// SUMMA on this rank's blocks: for every k panel, the grid column owning that
+// slice of A broadcasts its m x panel columns along each grid row, and the grid
+// row owning that slice of B its panel x n rows along each grid column; every
+// rank then adds the panel product to its block of C with the blocked kernel
+// and the whole team. Panels are cut at the slice boundaries of both grid
+// dimensions, so each has a single owner in each. The broadcasts of the next
+// panel are posted into the other of two buffers before the current one is
+// multiplied, so with an MPI that progresses nonblocking collectives in the
+// background the network stays off the critical path; stats.commWait is the
+// part it did not hide. Only the master thread calls MPI (MPI_THREAD_FUNNELED).
+const Result summaMatrixMultiplication(const Matrix& a, const Matrix& b, Matrix& c, const Shape& shape,
+                                       const ProcessGrid& grid, int NEIB, int panel, int nThreads, SummaStats& stats)
+{
+	struct Panel
+	{
+		int k0, width;
+		int ownerA, ownerB;  // grid column holding it in A, grid row holding it in B
+	};
+
+	const int m = c.rows, n = c.cols;
+	const int aK0 = partStart(shape.k, grid.cols, grid.col), bK0 = partStart(shape.k, grid.rows, grid.row);
+	double now = omp_get_wtime();
+
+	vector<Panel> panels;
+	for (int k0 = 0, q = 0, p = 0; k0 < shape.k;)
+	{
+		while (partStart(shape.k, grid.cols, q + 1) <= k0) q++;
+		while (partStart(shape.k, grid.rows, p + 1) <= k0) p++;
+		const int end = min({ k0 + panel, partStart(shape.k, grid.cols, q + 1), partStart(shape.k, grid.rows, p + 1) });
+		panels.push_back({ k0, end - k0, q, p });
+		k0 = end;
+	}
+
+	Matrix aPanel[2] = { Matrix(m, panel), Matrix(m, panel) };
+	Matrix bPanel[2] = { Matrix(panel, n), Matrix(panel, n) };
+	MPI_Request requests[2][2];
+
+	// The owners copy the panel out of their blocks; everyone receives it as
+	// strided rows, so the padding beyond the panel's width never travels
+	auto post = [&](size_t index) {
+		const Panel& next = panels[index];
+		Matrix& ap = aPanel[index % 2];
+		Matrix& bp = bPanel[index % 2];
+		if (grid.col == next.ownerA)
+		{
+			#pragma omp parallel for schedule(static) num_threads(nThreads)
+			for (int i = 0; i < m; i++) memcpy(ap.row(i), a.row(i) + (next.k0 - aK0), next.width * sizeof(double));
+		}
+		if (grid.row == next.ownerB)
+		{
+			#pragma omp parallel for schedule(static) num_threads(nThreads)
+			for (int r = 0; r < next.width; r++) memcpy(bp.row(r), b.row(next.k0 - bK0 + r), n * sizeof(double));
+		}
+
+		MPI_Datatype columns, rows;
+		MPI_Type_vector(m, next.width, ap.ld, MPI_DOUBLE, &columns);
+		MPI_Type_vector(next.width, n, bp.ld, MPI_DOUBLE, &rows);
+		MPI_Type_commit(&columns);
+		MPI_Type_commit(&rows);
+		MPI_Ibcast(ap.data, 1, columns, next.ownerA, grid.rowComm, &requests[index % 2][0]);
+		MPI_Ibcast(bp.data, 1, rows, next.ownerB, grid.colComm, &requests[index % 2][1]);
+		MPI_Type_free(&columns);  // freed once the broadcasts are done with them
+		MPI_Type_free(&rows);
+		stats.broadcastBytes += (static_cast<double>(m) + n) * next.width * sizeof(double);
+	};
+
+	post(0);
+	for (size_t i = 0; i < panels.size(); i++)
+	{
+		const double waiting = omp_get_wtime();
+		MPI_Waitall(2, requests[i % 2], MPI_STATUSES_IGNORE);
+		stats.commWait += omp_get_wtime() - waiting;
+
+		if (i + 1 < panels.size()) post(i + 1);
+		blockedMatrixMultiplication(aPanel[i % 2], bPanel[i % 2], c, Shape{ m, n, panels[i].width, false, false },
+		                            NEIB, nThreads);
+	}
+
+	return { omp_get_wtime() - now, nThreads };
+}
+
+// Method 9, one process per rank of mpirun: the seeded operands are the same
+// matrices the other methods multiply, each rank filling only its blocks.
+// Times are those of the slowest rank, and rank 0 prints the usual CSV line
+// or the benchmark report. --verify regenerates each rank's full block row of
+// A and block column of B and checks its block of C against them.
+int runDistributed(const Shape& shape, int NEIB, int nThreads, const Options& options)
+{
+	int provided;
+	MPI_Init_thread(nullptr, nullptr, MPI_THREAD_FUNNELED, &provided);
+	struct Session
+	{
+		~Session() { MPI_Finalize(); }
+	} session;
+	if (provided < MPI_THREAD_FUNNELED) throw runtime_error("MPI does not support calls from the master thread");
+
+	int ranks, rank;
+	MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	int dims[2] = { options.grid[0], options.grid[1] };
+	if (dims[0] == 0) MPI_Dims_create(ranks, 2, dims);
+	if (dims[0] * dims[1] != ranks) throw invalid_argument("--grid=PxQ must have one cell per MPI rank");
+	if (shape.m < dims[0] || shape.n < dims[1] || shape.k < max(dims[0], dims[1]))
+		throw invalid_argument("Every rank needs at least one row, column and k slice of the product");
+
+	ProcessGrid grid = { dims[0], dims[1], rank / dims[1], rank % dims[1], MPI_COMM_NULL, MPI_COMM_NULL };
+	MPI_Comm_split(MPI_COMM_WORLD, grid.row, grid.col, &grid.rowComm);
+	MPI_Comm_split(MPI_COMM_WORLD, grid.col, grid.row, &grid.colComm);
+
+	const int m0 = partStart(shape.m, grid.rows, grid.row), m1 = partStart(shape.m, grid.rows, grid.row + 1);
+	const int n0 = partStart(shape.n, grid.cols, grid.col), n1 = partStart(shape.n, grid.cols, grid.col + 1);
+	const int aK0 = partStart(shape.k, grid.cols, grid.col), aK1 = partStart(shape.k, grid.cols, grid.col + 1);
+	const int bK0 = partStart(shape.k, grid.rows, grid.row), bK1 = partStart(shape.k, grid.rows, grid.row + 1);
+	// Without --seed every rank drew its own, so all take rank 0's
+	uint64_t seed = options.seed;
+	MPI_Bcast(&seed, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+	Matrix a(m1 - m0, aK1 - aK0), b(bK1 - bK0, n1 - n0), c(m1 - m0, n1 - n0);
+	initializeSlice(a, seed, nThreads, shape.k, m0, aK0, options.density);
+	initializeSlice(b, seed + 1, nThreads, shape.n, bK0, n0);
+
+	omp_set_schedule(options.schedule.kind, options.schedule.chunk);
+	SummaStats stats;
+	vector<double> times, waits;
+	for (int run = 0; run < (options.reps > 0 ? options.warmup + options.reps : 1); run++)
+	{
+		c.fill(0.0, nThreads);
+		stats = SummaStats();
+		MPI_Barrier(MPI_COMM_WORLD);
+		const Result result = summaMatrixMultiplication(a, b, c, shape, grid, NEIB, options.panel, nThreads, stats);
+
+		double slowest[2], local[2] = { result.timestamp, stats.commWait };
+		MPI_Allreduce(local, slowest, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+		if (options.reps == 0 || run >= options.warmup)
+		{
+			times.push_back(slowest[0]);
+			waits.push_back(slowest[1]);
+		}
+	}
+	double broadcastBytes;
+	MPI_Reduce(&stats.broadcastBytes, &broadcastBytes, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+	bool verified = true;
+	if (options.verify)
+	{
+		Matrix aRows(m1 - m0, shape.k), bColumns(shape.k, n1 - n0);
+		initializeSlice(aRows, seed, nThreads, shape.k, m0, 0, options.density);
+		initializeSlice(bColumns, seed + 1, nThreads, shape.n, 0, n0);
+		Verification verification =
+			verifyResult(aRows, bColumns, c, Shape{ c.rows, c.cols, shape.k, false, false }, options, nThreads);
+		double worst;
+		MPI_Allreduce(&verification.worst, &worst, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+		verification.worst = worst;
+		verified = worst <= 1.0;
+		if (rank == 0) reportVerification(verification, 9, options.tolerance);
+	}
+	MPI_Comm_free(&grid.rowComm);
+	MPI_Comm_free(&grid.colComm);
+	if (rank != 0) return verified ? 0 : 2;
+
+	const string gridName = to_string(grid.rows) + "x" + to_string(grid.cols);
+	const Statistics waited = summarize(waits);
+	cerr << "Distributed: " << ranks << " ranks on a " << gridName << " grid, " << nThreads << " threads each, "
+	     << setprecision(1) << fixed << broadcastBytes / 1048576 << " MiB broadcast per run, " << setprecision(6)
+	     << waited.median << " s waiting for panels" << endl;
+
+	if (options.reps == 0)
+	{
+		cout << 9 << "," << nThreads << "," << fixed << setprecision(8) << times[0] << endl;
+		return verified ? 0 : 2;
+	}
+
+	const Statistics summary = summarize(times);
+	vector<ReportField> report = {
+		field("method", 9), field("ranks", ranks), field("grid", gridName), field("threads", nThreads),
+		field("m", shape.m), field("k", shape.k), field("n", shape.n), field("neib", NEIB),
+		field("panel", options.panel), field("warmup", options.warmup), field("reps", options.reps),
+		field("min", summary.min), field("median", summary.median), field("p95", summary.p95),
+		field("mean", summary.mean), field("stddev", summary.stddev),
+		field("gflops", 2.0 * shape.m * shape.n * shape.k / summary.median * 1e-9),
+		field("schedule", string(scheduleName(options.schedule))), field("chunk", options.schedule.chunk),
+		field("comm_wait", waited.median), field("broadcast_mib", broadcastBytes / 1048576)
+	};
+	if (options.verify) report.push_back(field("verified", string(verified ? "pass" : "fail")));
+	printReport(cout, report, options.format);
+	return verified ? 0 : 2;
+}
+#else
+int runDistributed(const Shape&, int, int, const Options&)
+{
+	throw invalid_argument("The distributed method needs the MPI build (make blocked-matrix-multiplication-mpi)");
+}
+#endif
+
+template <typename T>
+void BasicMatrix<T>::fill(double value, int nThreads)
+{
+	const T element = static_cast<T>(value);
+	#pragma omp parallel for schedule(static) num_threads(nThreads)
+	for (int i = 0; i < rows; i++)
+	{
+		T* ri = row(i);
+		for (int j = 0; j < ld; j++) ri[j] = element;
+	}
+}
+
+uint64_t randomSeed()
+{
+	random_device rd;
+	return (static_cast<uint64_t>(rd()) << 32) | rd();
+}
+
+// SplitMix64 finalizer: a bijective mix, so distinct counters give distinct,
+// well distributed outputs
+static inline uint64_t mix64(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// Uniform in [0, 1) from the top 53 bits of the mixed counter
+static inline double unitValue(uint64_t counter)
+{
+	return static_cast<double>(mix64(counter) >> 11) / 9007199254740992.0;
+}
+
+// Counter-based fill: element (i, j) is a pure function of (seed, i, j), so the
+// matrix is identical for any thread count or schedule, and rows are written
+// by the same static partition the kernels use.
+// Reduced precisions round the same values, so every precision multiplies
+// the nearest representable matrices. A transposed matrix holds the transpose
+// of the values it would hold untransposed, so op(A) and op(B) do not depend
+// on --transpose-a/b either. With density below 1 an element is kept only
+// when a second hash of its counter falls below it, so sparse operands are
+// reproducible the same way.
+template <typename T>
+void initializeMatrix(BasicMatrix<T>& matrix, uint64_t seed, int nThreads, bool transposed, double density,
+                      bool random)
+{
+	const uint64_t stream = mix64(seed);
+	// Counter step between stored rows and columns: op(X)(i, j) uses i * cols(op(X)) + j
+	const uint64_t rowStep = transposed ? 1 : matrix.cols, colStep = transposed ? matrix.rows : 1;
+
+	#pragma omp parallel for schedule(static) num_threads(nThreads)
+	for (int i = 0; i < matrix.rows; i++)
+	{
+		T* row = matrix.row(i);
+		const uint64_t base = stream + i * rowStep;
+		for (int j = 0; j < matrix.cols; j++)
+		{
+			const uint64_t counter = base + j * colStep;
+			double value;
+			if (random)
+				value = 10.0 * unitValue(counter);
+			else
+				value = i + j + 1;  // Simple pattern for testing
+			if (density < 1.0 && unitValue(~counter) >= density)
+				value = 0.0;
+			row[j] = static_cast<T>(value);
+		}
+		for (int j = matrix.cols; j < matrix.ld; j++) row[j] = static_cast<T>(0.0);
+	}
+}
+
+// Rows row0.. and columns col0.. of the untransposed fp64 matrix with cols
+// columns that initializeMatrix would fill from the same seed, so a rank of
+// the distributed method holds exactly its blocks of the operands.
+void initializeSlice(Matrix& matrix, uint64_t seed, int nThreads, int cols, int row0, int col0, double density)
+{
+	const uint64_t stream = mix64(seed);
+
+	#pragma omp parallel for schedule(static) num_threads(nThreads)
+	for (int i = 0; i < matrix.rows; i++)
+	{
+		double* row = matrix.row(i);
+		const uint64_t base = stream + static_cast<uint64_t>(row0 + i) * cols + col0;
+		for (int j = 0; j < matrix.cols; j++)
+		{
+			const uint64_t counter = base + j;
+			row[j] = density < 1.0 && unitValue(~counter) >= density ? 0.0 : 10.0 * unitValue(counter);
+		}
+		for (int j = matrix.cols; j < matrix.ld; j++) row[j] = 0.0;
+	}
+}
+
+void printMatrix(const Matrix& matrix, int size, int maxDisplay)
+{
+	int displaySize = min(size, maxDisplay);
+	for (int i = 0; i < displaySize; i++)
+	{
+		cout << "   ";
+		for (int j = 0; j < displaySize; j++)
+		{
+			cout << setw(8) << matrix(i, j) << " ";
+		}
+		if (size > maxDisplay) cout << "...";
+		cout << endl;
+	}
+	if (size > maxDisplay)
+	{
+		cout << "   ..." << endl;
+	}
+	cout << endl;
+}
+
+// Check c against a * b with an error bound that is relative per element and
+// grows with the inner dimension K (N for square products):
+// |C - AB|(i, j) <= tolerance * K * epsilon * (|A| |B|)(i, j),
+// the standard forward bound for any summation order, so FMA, blocking and
+// Strassen reorderings pass while dropped or doubled tiles do not. "full"
+// recomputes the product in O(MNK); "freivalds" compares C x with A (B x) for
+// random positive vectors x in O(MK + KN + MN), and the bound is carried
+// through the same products with |A| and |B|. "auto" picks full up to
+// fullVerifyLimit^3 multiply-adds. A and B are read as op(A) and op(B).
+// The reference is formed in double from the (possibly rounded) operands, and
+// epsilon is that of the accumulation type Out.
+template <typename In, typename Out>
+const Verification verifyResult(const BasicMatrix<In>& a, const BasicMatrix<In>& b, const BasicMatrix<Out>& c,
+                                const Shape& shape, const Options& options, int nThreads)
+{
+	const int fullVerifyLimit = 512;
+	const int freivaldsTrials = 2;
+	const int M = shape.m, N = shape.n, K = shape.k;
+	const double work = static_cast<double>(M) * N * K;
+	const bool full = strcmp(options.verify, "full") == 0 ||
+	                  (strcmp(options.verify, "auto") == 0 && work <= pow(fullVerifyLimit, 3.0));
+	const double bound = options.tolerance * max(K, 1) * static_cast<double>(numeric_limits<Out>::epsilon());
+	const Strides sa = Strides::of(a.ld, shape.transposeA), sb = Strides::of(b.ld, shape.transposeB);
+	double worst = 0.0;
+
+	if (full)
+	{
+		#pragma omp parallel num_threads(nThreads) reduction(max:worst)
+		{
+			vector<double> product(N), magnitude(N);
+
+			#pragma omp for schedule(static)
+			for (int i = 0; i < M; i++)
+			{
+				fill(product.begin(), product.end(), 0.0);
+				fill(magnitude.begin(), magnitude.end(), 0.0);
+				for (int k = 0; k < K; k++)
+				{
+					const In* bk = b.data + k * sb.row;
+					const double aik = static_cast<double>(a.data[i * sa.row + k * sa.col]);
+					for (int j = 0; j < N; j++)
+					{
+						const double term = aik * static_cast<double>(bk[j * sb.col]);
+						product[j] += term;
+						magnitude[j] += abs(term);
+					}
+				}
+
+				const Out* ci = c.row(i);
+				for (int j = 0; j < N; j++)
+				{
+					const double error = abs(static_cast<double>(ci[j]) - product[j]);
+					// NaN never compares greater, so count it explicitly
+					if (error != error) worst = numeric_limits<double>::infinity();
+					else if (error > 0.0) worst = max(worst, error / (bound * magnitude[j] + numeric_limits<double>::min()));
+				}
+			}
+		}
+		return { "full", worst };
+	}
+
+	vector<double> x(N), bx(K), bxMagnitude(K);
+	for (int trial = 0; trial < freivaldsTrials; trial++)
+	{
+		// x in [1, 2) keeps every term positive, so a missing contribution
+		// cannot be cancelled by another one
+		const uint64_t stream = mix64(options.seed ^ (0x5eedULL + trial));
+		for (int j = 0; j < N; j++)
+			x[j] = 1.0 + static_cast<double>(mix64(stream + j) >> 11) / 9007199254740992.0;
+
+		#pragma omp parallel for schedule(static) num_threads(nThreads)
+		for (int k = 0; k < K; k++)
+		{
+			const In* bk = b.data + k * sb.row;
+			double sum = 0.0, magnitude = 0.0;
+			for (int j = 0; j < N; j++)
+			{
+				const double bkj = static_cast<double>(bk[j * sb.col]);
+				sum += bkj * x[j];
+				magnitude += abs(bkj) * x[j];
+			}
+			bx[k] = sum;
+			bxMagnitude[k] = magnitude;
+		}
+
+		#pragma omp parallel for schedule(static) num_threads(nThreads) reduction(max:worst)
+		for (int i = 0; i < M; i++)
+		{
+			const In* ai = a.data + i * sa.row;
+			const Out* ci = c.row(i);
+			double abx = 0.0, magnitude = 0.0, cx = 0.0;
+			for (int k = 0; k < K; k++)
+			{
+				const double aik = static_cast<double>(ai[k * sa.col]);
+				abx += aik * bx[k];
+				magnitude += abs(aik) * bxMagnitude[k];
+			}
+			for (int j = 0; j < N; j++) cx += static_cast<double>(ci[j]) * x[j];
+
+			// Forming A (B x) and C x adds two more dot-product errors
+			const double error = abs(cx - abx);
+			if (error != error) worst = numeric_limits<double>::infinity();
+			else if (error > 0.0)
+				worst = max(worst, error / ((bound + 2.0 * max(N, K) * numeric_limits<double>::epsilon()) * magnitude +
+				                            numeric_limits<double>::min()));
+		}
+	}
+	return { "freivalds", worst };
+}
+
+// Print the outcome of --verify on stderr; returns whether the check passed
+bool reportVerification(const Verification& verification, short method, double tolerance)
+{
+	const bool passed = verification.worst <= 1.0;
+	cerr << "Verification " << (passed ? "passed" : "FAILED") << ": method " << method << ", " << verification.check
+	     << " check, worst error " << scientific << setprecision(3) << verification.worst
+	     << " of the bound (tolerance " << defaultfloat << tolerance << ")" << endl;
+	return passed;
+}
+
+// Server mode: a long-running process that keeps its matrices, the pooled
+// packing and Strassen workspace and the OpenMP team alive across requests.
+// Clients connect to the Unix socket at path, one at a time, and send:
+//   matrix <name> <N>          create (or replace) a resident N x N matrix in
+//                              shared memory; reply "ok <object> <N> <ld>"
+//   random <name> <seed>       fill it from the counter-based generator
+//   zero <name>                fill it with zeros
+//   multiply <c> <a> <b> <method> <NEIB> <threads>
+//                              c = a * b; reply "ok <seconds> <gflops>"
+//   free <name>                drop the matrix and its shared memory object
+//   quit | shutdown            close this connection | stop the server (as
+//                              SIGINT and SIGTERM do)
+// A client maps <object> with shm_open and writes operands or reads the
+// product in place (row i starts at element i * ld), so results come back
+// without a copy. Errors reply "error <message>". The other options (kernel,
+// schedule, packed sizes, verify, ...) come from the command line.
+int serve(const char* path, const Options& options)
+{
+	if (options.precision != fp64)
+	{
+		cerr << "Error: shared matrices are fp64, --precision=" << precisionName(options.precision) << " cannot serve"
+		     << endl;
+		return 1;
+	}
+	if (options.device >= 0)
+	{
+		cerr << "Error: --device runs in batch mode only" << endl;
+		return 1;
+	}
+
+	const int listener = listenOn(path);
+	if (listener < 0) return 1;
+
+	const string prefix = "/bmm-" + to_string(getpid()) + "-";
+	map<string, Matrix> matrices;
+	bool running = true;
+
+	while (running && !stopServing)
+	{
+		Connection client = { accept(listener, nullptr, nullptr), string() };
+		if (client.fd < 0) continue;
+
+		string line;
+		while (client.readLine(line))
+		{
+			istringstream request(line);
+			string command;
+			request >> command;
+			ostringstream reply;
+			try
+			{
+				if (command == "quit") break;
+				if (command == "shutdown")
+				{
+					running = false;
+					client.writeLine("ok");
+					break;
+				}
+
+				if (command == "matrix")
+				{
+					string name;
+					int N = 0;
+					if (!(request >> name >> N) || N <= 0) throw invalid_argument("usage: matrix <name> <N>");
+					matrices.erase(name);
+					const Matrix& m = matrices.emplace(name, Matrix(N, N, prefix + name)).first->second;
+					reply << "ok " << m.sharedName << ' ' << N << ' ' << m.ld;
+				}
+				else if (command == "random" || command == "zero" || command == "free")
+				{
+					string name;
+					uint64_t seed = 0;
+					request >> name;
+					auto entry = matrices.find(name);
+					if (entry == matrices.end()) throw invalid_argument("no matrix " + name);
+					if (command == "random" && !(request >> seed)) throw invalid_argument("usage: random <name> <seed>");
+
+					if (command == "random")
+						initializeMatrix(entry->second, seed, omp_get_max_threads());
+					else if (command == "zero") entry->second.fill(0.0);
+					else matrices.erase(entry);
+					reply << "ok";
+				}
+				else if (command == "multiply")
+				{
+					string names[3];
+					int method = 0, NEIB = 0, threads = 0;
+					if (!(request >> names[0] >> names[1] >> names[2] >> method >> NEIB >> threads) || threads <= 0)
+						throw invalid_argument("usage: multiply <c> <a> <b> <method> <NEIB> <threads>");
+					Matrix* m[3];
+					for (int i = 0; i < 3; i++)
+					{
+						auto entry = matrices.find(names[i]);
+						if (entry == matrices.end()) throw invalid_argument("no matrix " + names[i]);
+						m[i] = &entry->second;
+					}
+					const int N = m[0]->rows;
+					if (m[1]->rows != N || m[2]->rows != N) throw invalid_argument("matrix sizes differ");
+					if (m[0] == m[1] || m[0] == m[2]) throw invalid_argument("the product cannot overwrite an operand");
+					if ((method == 1 || method == 5) && NEIB <= 0)
+						throw invalid_argument("Block size must be positive for blocked methods");
+
+					Matrix& c = *m[0];
+					c.fill(0.0, threads);
+					const Result result = runMethod(method, *m[1], *m[2], c, squareShape(N), NEIB, threads, options);
+					reply << "ok " << setprecision(9) << result.timestamp << ' '
+					      << 2.0 * N * N * N / result.timestamp * 1e-9;
+					if (options.verify)
+						reply << (reportVerification(verifyResult(*m[1], *m[2], c, squareShape(N), options, threads), method,
+						                             options.tolerance) ? " pass" : " fail");
+				}
+				else throw invalid_argument("unknown command " + command);
+			}
+			catch (exception& e)
+			{
+				reply.str("");
+				reply << "error " << e.what();
+			}
+			client.writeLine(reply.str());
+		}
+		close(client.fd);
+	}
+
+	if (stopServing) cerr << "Stopped by signal" << endl;
+	close(listener);
+	unlink(path);
+	return 0;
 }
@@ -0,0 +1,587 @@
+// Helpers shared by numerical-integration.cpp and blocked-matrix-multiplication.cpp:
+// run statistics and machine-readable reports, perf_event counters, the
+// parallel-region tracer and the server's socket plumbing
+#ifndef COMMON_HPP
+#define COMMON_HPP
+
+#include <stdio.h>
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <limits>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+// Summary of the measured runs of one benchmark configuration
+struct Statistics
+{
+	double min, median, p95, mean, stddev;
+};
+
+// One named column of a machine-readable report; text values are quoted in JSON
+struct ReportField
+{
+	string name, value;
+	bool text;
+};
+
+// Linux perf_event counters of the kernel team. Every team thread opens its
+// own set for itself, so the reused OpenMP pool threads are counted whatever
+// share of the work they get. Events the host does not expose (no PMU in a
+// VM, other systems) stay closed and read as NaN. Busy time is not a perf
+// event: the task clock also counts a thread spinning at a barrier, so it is
+// the wall-clock time the tracer sees each thread spend in loop iterations.
+struct KernelCounters
+{
+	enum Event { cycles, instructions, l1dMisses, llcMisses, events };
+
+	explicit KernelCounters(int nThreads);
+	~KernelCounters();
+	void start();
+	void stop();  // adds the counts since start to the totals
+	double total(Event event) const;  // summed over threads and measured runs
+	double busy(int thread) const;    // work seconds of one thread, summed over runs
+
+	int nThreads;
+	vector<int> fds;  // events descriptors per thread, -1 when not opened
+	vector<double> counts;
+	vector<double> busySeconds, busyStart;  // per thread, and the tracer's totals at start
+	long long regions = 0, regionsStart = 0;  // traced regions run between start and stop
+};
+
+// Built-in tracer of the kernels' parallel regions (--trace=<file>). libgomp
+// has no OMPT interface, so a traced region is bracketed by begin/end on the
+// calling thread and each loop iteration in it is timed by the thread that
+// runs it (TracedIteration). Each thread's share of a region then splits into
+//   fork      region start to its first iteration
+//   work      inside iterations
+//   schedule  between its iterations: chunk hand-out and, in regions with
+//             several loops, the barriers between them
+//   barrier   its last iteration to the last thread's
+//   join      the last thread's last iteration to the region end
+// which add up to the region's wall time. Only outermost regions are traced,
+// and only while enabled.
+struct Tracer
+{
+	struct Span
+	{
+		const char* name;
+		const char* category;
+		double start, end;
+	};
+
+	// One thread of the region in progress, plus its timeline so far
+	struct Thread
+	{
+		double first, last, work, schedule;
+		double busy;  // work over every traced region so far, for KernelCounters
+		long long iterations;
+		vector<Span> spans;
+	};
+
+	// Thread-seconds of each phase over every call of one region
+	struct Totals
+	{
+		long long calls = 0;
+		double wall = 0, threadTime = 0, fork = 0, work = 0, schedule = 0, barrier = 0, join = 0;
+		double busiest = 0, meanWork = 0;  // summed per call, for the imbalance
+	};
+
+	static const size_t maxSpans = 1 << 18;  // timeline events kept per thread
+
+	bool enabled = false;
+	bool timeline = false;  // keep the spans for write, not only the totals
+	long long regions = 0;  // traced regions ended so far
+	const char* region = nullptr;  // name of the traced region in progress
+	double origin = 0, regionStart = 0;
+	int regionThreads = 0;
+	vector<Thread> threads;
+	map<string, Totals> totals;
+
+	void begin(const char* name, int nThreads);
+	void end();
+	void record(Thread& thread, double start, double end);
+	const Totals overall() const;
+	bool write(const char* file) const;
+	void summarize(ostream& out) const;
+};
+
+static Tracer tracer;
+
+// Times one loop iteration for the tracer, when the region around it is traced
+struct TracedIteration
+{
+	Tracer::Thread* thread = nullptr;
+	double start = 0;
+
+	TracedIteration()
+	{
+		if (!tracer.region || omp_get_level() != 1) return;
+		thread = &tracer.threads[omp_get_thread_num()];
+		start = omp_get_wtime();
+	}
+	~TracedIteration()
+	{
+		if (thread) tracer.record(*thread, start, omp_get_wtime());
+	}
+};
+
+// Set by SIGINT/SIGTERM once the server listens: the serve loop stops after
+// the request in progress and cleans up
+static volatile sig_atomic_t stopServing = 0;
+
+// One client of the server: requests and replies are newline-terminated text
+// lines. A line longer than maxLine gets an error reply and ends the connection.
+struct Connection
+{
+	static const size_t maxLine = 1 << 16;
+
+	int fd;
+	string pending;
+
+	bool readLine(string& line)
+	{
+		while (true)
+		{
+			const size_t end = pending.find('\n');
+			if (end != string::npos && end <= maxLine)
+			{
+				line = pending.substr(0, end);
+				pending.erase(0, end + 1);
+				return true;
+			}
+			if (pending.size() > maxLine)
+			{
+				writeLine("error request line longer than " + to_string(maxLine) + " bytes");
+				return false;
+			}
+			if (stopServing) return false;
+			char buffer[4096];
+			const ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+			if (count <= 0) return false;
+			pending.append(buffer, count);
+		}
+	}
+
+	void writeLine(const string& line)
+	{
+		const string framed = line + "\n";
+		for (size_t sent = 0; sent < framed.size(); )
+		{
+			const ssize_t count = send(fd, framed.data() + sent, framed.size() - sent, 0);
+			if (count <= 0) return;
+			sent += count;
+		}
+	}
+};
+
+inline string cpuModel()
+{
+#ifdef __APPLE__
+	char brand[256];
+	size_t size = sizeof(brand);
+	if (sysctlbyname("machdep.cpu.brand_string", brand, &size, nullptr, 0) == 0) return brand;
+#else
+	ifstream cpuinfo("/proc/cpuinfo");
+	string line;
+	while (getline(cpuinfo, line))
+	{
+		if (line.compare(0, 10, "model name") != 0) continue;
+		const size_t colon = line.find(':');
+		if (colon != string::npos) return line.substr(line.find_first_not_of(' ', colon + 1));
+	}
+#endif
+	return "unknown";
+}
+
+// The median averages the two middle runs of an even count and p95 uses the
+// nearest-rank definition; stddev is the sample standard deviation (0 for a
+// single run)
+inline const Statistics summarize(vector<double> samples)
+{
+	sort(samples.begin(), samples.end());
+	const size_t count = samples.size();
+	Statistics stats;
+	stats.min = samples.front();
+	stats.median = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+	stats.p95 = samples[static_cast<size_t>(ceil(0.95 * count)) - 1];
+
+	double sum = 0.0;
+	for (double sample : samples) sum += sample;
+	stats.mean = sum / count;
+
+	double squares = 0.0;
+	for (double sample : samples) squares += (sample - stats.mean) * (sample - stats.mean);
+	stats.stddev = count > 1 ? sqrt(squares / (count - 1)) : 0.0;
+	return stats;
+}
+
+// 17 significant digits round-trip a double, so reported values can be
+// compared bit for bit across runs
+inline ReportField field(const char* name, double value)
+{
+	ostringstream text;
+	text << setprecision(17) << value;
+	return { name, text.str(), false };
+}
+
+inline ReportField field(const char* name, long long value)
+{
+	return { name, to_string(value), false };
+}
+
+inline ReportField field(const char* name, int value)
+{
+	return field(name, static_cast<long long>(value));
+}
+
+inline ReportField field(const char* name, const string& value)
+{
+	return { name, value, true };
+}
+
+// CSV prints a header line (unless header is false) and a value line; JSON prints one object
+inline void printReport(ostream& out, const vector<ReportField>& report, const char* format, bool header = true)
+{
+	if (strcmp(format, "json") == 0)
+	{
+		out << "{";
+		for (size_t i = 0; i < report.size(); i++)
+		{
+			const ReportField& column = report[i];
+			out << (i ? ", " : "") << '"' << column.name << "\": ";
+			if (column.text) out << '"' << column.value << '"';
+			else if (column.value == "nan" || column.value == "inf" || column.value == "-inf") out << "null";
+			else out << column.value;
+		}
+		out << "}" << endl;
+		return;
+	}
+
+	if (header)
+	{
+		for (size_t i = 0; i < report.size(); i++) out << (i ? "," : "") << report[i].name;
+		out << endl;
+	}
+	for (size_t i = 0; i < report.size(); i++) out << (i ? "," : "") << report[i].value;
+	out << endl;
+}
+
+#ifdef __linux__
+static int openCounter(uint32_t type, uint64_t config)
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;  // user-space counts are allowed at the default perf_event_paranoid
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+inline KernelCounters::KernelCounters(int nThreads)
+	: nThreads(nThreads), fds(static_cast<size_t>(nThreads) * events, -1), counts(fds.size(), 0.0),
+	  busySeconds(nThreads, 0.0), busyStart(nThreads, 0.0)
+{
+#ifdef __linux__
+	const uint64_t l1dReadMiss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	#pragma omp parallel num_threads(nThreads)
+	{
+		int* own = &fds[static_cast<size_t>(omp_get_thread_num()) * events];
+		own[cycles] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		own[instructions] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		own[l1dMisses] = openCounter(PERF_TYPE_HW_CACHE, l1dReadMiss);
+		own[llcMisses] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	}
+#endif
+}
+
+inline KernelCounters::~KernelCounters()
+{
+	for (int fd : fds)
+		if (fd >= 0) close(fd);
+}
+
+// The tracer must be enabled between start and stop for the busy times
+inline void KernelCounters::start()
+{
+	for (int thread = 0; thread < nThreads; thread++)
+		busyStart[thread] = static_cast<size_t>(thread) < tracer.threads.size() ? tracer.threads[thread].busy : 0.0;
+	regionsStart = tracer.regions;
+#ifdef __linux__
+	for (int fd : fds)
+	{
+		if (fd < 0) continue;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+// Counts are scaled by enabled/running time when the kernel had to
+// multiplex more events than the PMU has counters
+inline void KernelCounters::stop()
+{
+	for (int thread = 0; thread < nThreads; thread++)
+		if (static_cast<size_t>(thread) < tracer.threads.size())
+			busySeconds[thread] += tracer.threads[thread].busy - busyStart[thread];
+	regions += tracer.regions - regionsStart;
+#ifdef __linux__
+	for (int fd : fds)
+		if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	for (size_t i = 0; i < fds.size(); i++)
+	{
+		uint64_t value[3];  // count, time enabled, time running
+		if (fds[i] < 0 || read(fds[i], value, sizeof(value)) != sizeof(value) || value[2] == 0) continue;
+		counts[i] += static_cast<double>(value[0]) * value[1] / value[2];
+	}
+#endif
+}
+
+// NaN unless every thread could open the event
+inline double KernelCounters::total(Event event) const
+{
+	double sum = 0.0;
+	for (int thread = 0; thread < nThreads; thread++)
+	{
+		const size_t i = static_cast<size_t>(thread) * events + event;
+		if (fds[i] < 0) return numeric_limits<double>::quiet_NaN();
+		sum += counts[i];
+	}
+	return sum;
+}
+
+// NaN for methods without traced parallel regions
+inline double KernelCounters::busy(int thread) const
+{
+	return regions ? busySeconds[thread] : numeric_limits<double>::quiet_NaN();
+}
+
+inline void Tracer::begin(const char* name, int nThreads)
+{
+	if (!enabled || omp_get_level() > 0) return;
+	if (threads.size() < static_cast<size_t>(nThreads)) threads.resize(nThreads);
+	for (Thread& thread : threads)
+	{
+		thread.work = thread.schedule = 0;
+		thread.iterations = 0;
+	}
+	region = name;
+	regionThreads = nThreads;
+	regionStart = omp_get_wtime();
+}
+
+inline void Tracer::record(Thread& thread, double start, double end)
+{
+	if (thread.iterations++ == 0) thread.first = start;
+	else thread.schedule += start - thread.last;
+	thread.work += end - start;
+	thread.last = end;
+	thread.busy += end - start;
+	if (timeline && thread.spans.size() < maxSpans) thread.spans.push_back({ "work", "work", start, end });
+}
+
+// A thread without iterations waits at the barrier from the region start to
+// the last thread's last iteration, then in the join like the others
+inline void Tracer::end()
+{
+	if (!region) return;
+	const double finish = omp_get_wtime();
+	double lastArrival = regionStart, busiest = 0, work = 0;
+	for (int i = 0; i < regionThreads; i++)
+	{
+		Thread& thread = threads[i];
+		if (thread.iterations == 0) thread.first = thread.last = regionStart;
+		lastArrival = max(lastArrival, thread.last);
+		busiest = max(busiest, thread.work);
+		work += thread.work;
+	}
+
+	Totals& sum = totals[region];
+	sum.calls++;
+	sum.wall += finish - regionStart;
+	sum.threadTime += regionThreads * (finish - regionStart);
+	sum.join += regionThreads * (finish - lastArrival);
+	sum.busiest += busiest;
+	sum.meanWork += work / regionThreads;
+	for (int i = 0; i < regionThreads; i++)
+	{
+		Thread& thread = threads[i];
+		sum.fork += thread.first - regionStart;
+		sum.work += thread.work;
+		sum.schedule += thread.schedule;
+		sum.barrier += lastArrival - thread.last;
+
+		const Span phases[] = { { region, "region", regionStart, finish },
+		                        { "fork", "overhead", regionStart, thread.first },
+		                        { "barrier", "overhead", thread.last, lastArrival },
+		                        { "join", "overhead", lastArrival, finish } };
+		for (const Span& span : phases)
+			if (timeline && span.end > span.start && thread.spans.size() < maxSpans) thread.spans.push_back(span);
+	}
+	regions++;
+	region = nullptr;
+}
+
+inline const Tracer::Totals Tracer::overall() const
+{
+	Totals all;
+	for (const auto& entry : totals)
+	{
+		const Totals& sum = entry.second;
+		all.calls += sum.calls;
+		all.wall += sum.wall;
+		all.threadTime += sum.threadTime;
+		all.fork += sum.fork;
+		all.work += sum.work;
+		all.schedule += sum.schedule;
+		all.barrier += sum.barrier;
+		all.join += sum.join;
+		all.busiest += sum.busiest;
+		all.meanWork += sum.meanWork;
+	}
+	return all;
+}
+
+// Chrome trace event format (chrome://tracing, ui.perfetto.dev): one track
+// per OpenMP thread, times in microseconds since the first run started
+inline bool Tracer::write(const char* file) const
+{
+	ofstream out(file);
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	for (size_t t = 0; t < threads.size(); t++)
+		out << (t ? "," : "") << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << t
+		    << ", \"args\": {\"name\": \"OpenMP thread " << t << "\"}}";
+	out << fixed << setprecision(3);
+	for (size_t t = 0; t < threads.size(); t++)
+		for (const Span& span : threads[t].spans)
+			out << ",\n{\"name\": \"" << span.name << "\", \"cat\": \"" << span.category
+			    << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << t << ", \"ts\": " << (span.start - origin) * 1e6
+			    << ", \"dur\": " << (span.end - span.start) * 1e6 << "}";
+	out << "\n]}" << endl;
+	return static_cast<bool>(out);
+}
+
+// Phase shares are of the thread time (team size x wall) of each region;
+// imbalance is the busiest thread's work over the mean, summed over calls
+inline void Tracer::summarize(ostream& out) const
+{
+	out << left << setw(24) << "region" << right << setw(8) << "calls" << setw(12) << "wall s" << setw(8) << "work"
+	    << setw(10) << "schedule" << setw(8) << "fork" << setw(9) << "barrier" << setw(8) << "join" << setw(11)
+	    << "imbalance" << endl;
+	for (const auto& entry : totals)
+	{
+		const Totals& sum = entry.second;
+		out << left << setw(24) << entry.first << right << setw(8) << sum.calls << fixed << setprecision(6)
+		    << setw(12) << sum.wall << setprecision(1);
+		const double phases[] = { sum.work, sum.schedule, sum.fork, sum.barrier, sum.join };
+		const int widths[] = { 7, 9, 7, 8, 7 };
+		for (int i = 0; i < 5; i++) out << setw(widths[i]) << 100 * phases[i] / sum.threadTime << "%";
+		out << setprecision(2) << setw(11) << sum.busiest / sum.meanWork << defaultfloat << endl;
+	}
+}
+
+// Shares of the thread time of all traced regions together
+inline void addTraceFields(vector<ReportField>& report)
+{
+	const Tracer::Totals all = tracer.overall();
+	report.push_back(field("trace_regions", all.calls));
+	report.push_back(field("trace_work", all.work / all.threadTime));
+	report.push_back(field("trace_schedule", all.schedule / all.threadTime));
+	report.push_back(field("trace_fork", all.fork / all.threadTime));
+	report.push_back(field("trace_barrier", all.barrier / all.threadTime));
+	report.push_back(field("trace_join", all.join / all.threadTime));
+	report.push_back(field("trace_imbalance", all.busiest / all.meanWork));
+}
+
+inline void reportTrace(const char* file)
+{
+	if (tracer.totals.empty())
+	{
+		cerr << "Trace: this method has no traced parallel regions" << endl;
+		return;
+	}
+	if (!tracer.write(file)) cerr << "Error: could not write trace file " << file << endl;
+	else cerr << "Trace of the traced parallel regions written to " << file << endl;
+	tracer.summarize(cerr);
+}
+
+static pthread_t serverThread;
+
+// Any thread of the process may take the signal, but only the server thread
+// sits in accept or recv, so the others pass it on to interrupt that call
+static void requestStop(int signal)
+{
+	stopServing = 1;
+	if (!pthread_equal(pthread_self(), serverThread)) pthread_kill(serverThread, signal);
+}
+
+// Bind the server's Unix socket at path, install the stop handler and wake the
+// OpenMP team once, so the first request does not pay for creating it; -1
+// (after an error message) on failure
+inline int listenOn(const char* path)
+{
+	const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (listener < 0 || strlen(path) >= sizeof(address.sun_path))
+	{
+		cerr << "Error: cannot create socket " << path << endl;
+		if (listener >= 0) close(listener);
+		return -1;
+	}
+	strcpy(address.sun_path, path);
+	unlink(path);
+	if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 8) != 0)
+	{
+		cerr << "Error: cannot listen on " << path << ": " << strerror(errno) << endl;
+		close(listener);
+		return -1;
+	}
+	// A client that disconnects mid-reply must not kill the server
+	signal(SIGPIPE, SIG_IGN);
+	// No SA_RESTART, so a blocked accept or recv returns EINTR
+	struct sigaction stop = {};
+	stop.sa_handler = requestStop;
+	sigemptyset(&stop.sa_mask);
+	serverThread = pthread_self();
+	sigaction(SIGINT, &stop, nullptr);
+	sigaction(SIGTERM, &stop, nullptr);
+	cerr << "Serving on " << path << " with " << omp_get_max_threads() << " threads" << endl;
+
+	vector<int> awake(omp_get_max_threads());
+	#pragma omp parallel
+	awake[omp_get_thread_num()] = 1;
+	return listener;
+}
+
+#endif
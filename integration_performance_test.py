@@ -5,6 +5,7 @@ Tests rectangle, trapezoidal, and sequential approaches with varying thread coun
 Generates speedup graphs
 """
 
+import csv
 import subprocess
 import time
 import pandas as pd
@@ -12,8 +13,17 @@ import matplotlib.pyplot as plt
 import numpy as np
 import os
 
+
+def parse_value(text):
+    """Convert a benchmark CSV field to float where possible, leaving text columns as strings"""
+    try:
+        return float(text)
+    except ValueError:
+        return text
+
+
 class NumericalIntegrationTester:
-    def __init__(self, x1=0, x2=3.14159, dx=0.0001):
+    def __init__(self, x1=0, x2=3.14159, dx=0.0001, reduction="neumaier", integrand="sin"):
         """
         Initialize the tester with integration parameters
         
@@ -21,17 +31,29 @@ class NumericalIntegrationTester:
             x1 (float): Lower bound of integration
             x2 (float): Upper bound of integration  
             dx (float): Step size for integration
+            reduction (str): How parallel methods combine partial sums: naive, neumaier, pairwise or deterministic
+            integrand (str): Registry name passed to --integrand, e.g. "gaussian" or "expr:x^2"
         """
         self.x1 = x1
         self.x2 = x2
         self.dx = dx
+        self.reduction = reduction
+        self.integrand = integrand
         self.executable = "./numerical-integration"
         self.thread_counts = [1, 2, 4, 8, 16]
         self.methods = {
             1: "Rectangle (OpenMP)",
             2: "Trapezoidal (OpenMP)",
             3: "Rectangle (Sequential)",
-            4: "Trapezoidal (Sequential)"
+            4: "Trapezoidal (Sequential)",
+            5: "Rectangle (OpenMP SIMD)",
+            6: "Trapezoidal (OpenMP SIMD)",
+            7: "Adaptive Simpson (OpenMP tasks)",
+            8: "Gauss-Kronrod (OpenMP tasks)",
+            9: "Simpson (OpenMP SIMD)",
+            10: "Gauss-Legendre (OpenMP SIMD)",
+            11: "Monte Carlo (OpenMP)",
+            12: "Quasi-Monte Carlo (OpenMP)"
         }
         self.results = []
         
@@ -39,62 +61,74 @@ class NumericalIntegrationTester:
         self.expected_result = 2.0  # integral of sin(x) from 0 to π
         self.tolerance = 0.01  # 1% tolerance for numerical accuracy
     
-    def run_single_test(self, method, threads):
+    def run_single_test(self, method, threads, reps=3, warmup=1, reduction=None, step=None, extra=(), schedule=None):
         """
-        Run a single test configuration
+        Benchmark one configuration in a single process
         
         Args:
             method (int): 1=rectangle, 2=trapezoidal, 3=seq_rectangle, 4=seq_trapezoidal
             threads (int): Number of threads to use
+            reps (int): Measured repetitions inside the benchmark process
+            warmup (int): Untimed repetitions before measuring
+            reduction (str): Reduction strategy for this run (None = the tester's default)
+            step (float): Value passed in the dx slot (None = self.dx); methods 7/8 read it as the tolerance,
+                methods 11/12 as the target standard error
+            extra (tuple): Further command line options for this run
+            schedule (str): Chunk loop schedule "kind[,chunk]" for this run (None = the binary's dynamic,1)
             
         Returns:
-            tuple: (execution_time, area_result)
+            dict: Benchmark statistics (area, evaluations, min, median, p95, mean, stddev, evals_per_sec)
         """
         # For sequential methods, threads parameter is ignored but still required
-        actual_threads = 1 if method >= 3 else threads
+        actual_threads = 1 if method in (3, 4) else threads
         
-        cmd = [self.executable, str(self.x1), str(self.x2), str(self.dx), str(method), str(actual_threads)]
+        cmd = [self.executable, str(self.x1), str(self.x2), str(step or self.dx), str(method), str(actual_threads),
+               f"--warmup={warmup}", f"--reps={reps}", "--format=csv",
+               f"--reduction={reduction or self.reduction}", f"--integrand={self.integrand}", *extra]
+        if schedule is not None:
+            cmd.append(f"--schedule={schedule}")
         
         try:
             # Run the command and capture output
-            result = subprocess.run(cmd, capture_output=True, text=True, timeout=30)
+            result = subprocess.run(cmd, capture_output=True, text=True, timeout=30 * (warmup + reps))
             
             if result.returncode != 0:
                 print(f"Error running {self.methods[method]} with {threads} threads:")
                 print(result.stderr)
-                return None, None
+                return None
             
-            # Parse CSV output: method,threads,time,area
-            output_line = result.stdout.strip()
-            parts = output_line.split(',')
+            # Parse benchmark CSV output: header line followed by one value line
+            rows = list(csv.DictReader(result.stdout.strip().splitlines()))
             
-            if len(parts) == 4:
-                exec_time = float(parts[2])
-                area = float(parts[3])
+            if len(rows) == 1 and 'median' in rows[0]:
+                stats = {key: parse_value(value) for key, value in rows[0].items()}
                 
-                # Validate numerical accuracy
-                error = abs(area - self.expected_result) / self.expected_result
-                if error > self.tolerance:
+                # Validate numerical accuracy (the expected area is only known for sin)
+                error = abs(stats['area'] - self.expected_result) / self.expected_result
+                if self.integrand == "sin" and error > self.tolerance:
                     print(f"Warning: Large numerical error ({error:.3f}) for {self.methods[method]} with {threads} threads")
                 
-                return exec_time, area
+                return stats
             else:
-                print(f"Unexpected output format: {output_line}")
-                return None, None
+                print(f"Unexpected output format: {result.stdout.strip()}")
+                return None
                 
         except subprocess.TimeoutExpired:
             print(f"Test timed out: {self.methods[method]} with {threads} threads")
-            return None, None
+            return None
         except Exception as e:
             print(f"Error running test: {e}")
-            return None, None
+            return None
     
     def run_all_tests(self, runs_per_test=3):
         """
-        Run all test configurations multiple times and average results
+        Run all test configurations, repeating each inside one benchmark process
+        
+        The cost model is kept off, so every run uses the team it asked for; speedup and efficiency
+        are still taken against the team that actually ran (threads_used).
         
         Args:
-            runs_per_test (int): Number of runs per configuration for averaging
+            runs_per_test (int): Measured repetitions per configuration (after one warmup run)
         """
         print(f"Testing numerical integration performance")
         print(f"Integration bounds: [{self.x1}, {self.x2}]")
@@ -111,26 +145,23 @@ class NumericalIntegrationTester:
             method_name = self.methods[method_id]
             print(f"Testing {method_name}...")
             
-            times = []
-            areas = []
-            for run in range(runs_per_test):
-                exec_time, area = self.run_single_test(method_id, 1)
-                if exec_time is not None:
-                    times.append(exec_time)
-                    areas.append(area)
+            stats = self.run_single_test(method_id, 1, runs_per_test, extra=("--cost-model=off",))
             
-            if times:
-                avg_time = np.mean(times)
-                avg_area = np.mean(areas)
+            if stats:
                 self.results.append({
                     'Method': method_name,
                     'Threads': 1,
-                    'Time': avg_time,
-                    'Area': avg_area,
+                    'Threads_Used': 1,
+                    'Time': stats['median'],
+                    'Min': stats['min'],
+                    'P95': stats['p95'],
+                    'Stddev': stats['stddev'],
+                    'EvalsPerSec': stats['evals_per_sec'],
+                    'Area': stats['area'],
                     'Speedup': 1.0,
                     'Efficiency': 1.0
                 })
-                print(f"  Result: {avg_time:.6f} seconds, area: {avg_area:.8f}")
+                print(f"  Result: {stats['median']:.6f} seconds, area: {stats['area']:.8f}")
             else:
                 print(f"  {method_name}: FAILED")
         
@@ -144,7 +175,8 @@ class NumericalIntegrationTester:
                 seq_trap_time = result['Time']
         
         # Test parallel methods with different thread counts
-        for method_id, method_name in [(1, "Rectangle (OpenMP)"), (2, "Trapezoidal (OpenMP)")]:
+        for method_id, method_name in [(1, "Rectangle (OpenMP)"), (2, "Trapezoidal (OpenMP)"),
+                                       (5, "Rectangle (OpenMP SIMD)"), (6, "Trapezoidal (OpenMP SIMD)")]:
             print(f"\nTesting {method_name}...")
             
             # Choose appropriate sequential baseline
@@ -154,34 +186,481 @@ class NumericalIntegrationTester:
                 continue
             
             for threads in self.thread_counts:
-                times = []
-                areas = []
-                
-                for run in range(runs_per_test):
-                    exec_time, area = self.run_single_test(method_id, threads)
-                    if exec_time is not None:
-                        times.append(exec_time)
-                        areas.append(area)
+                stats = self.run_single_test(method_id, threads, runs_per_test, extra=("--cost-model=off",))
                 
-                if times:
-                    avg_time = np.mean(times)
-                    avg_area = np.mean(areas)
-                    speedup = baseline_time / avg_time
-                    efficiency = speedup / threads
+                if stats:
+                    median_time = stats['median']
+                    speedup = baseline_time / median_time
+                    threads_used = int(stats['threads_used'])
+                    efficiency = speedup / threads_used
                     
                     self.results.append({
                         'Method': method_name,
                         'Threads': threads,
-                        'Time': avg_time,
-                        'Area': avg_area,
+                        'Threads_Used': threads_used,
+                        'Time': median_time,
+                        'Min': stats['min'],
+                        'P95': stats['p95'],
+                        'Stddev': stats['stddev'],
+                        'EvalsPerSec': stats['evals_per_sec'],
+                        'Area': stats['area'],
                         'Speedup': speedup,
                         'Efficiency': efficiency
                     })
                     
-                    print(f"  {threads:2d} threads: {avg_time:.6f}s, speedup: {speedup:.2f}x, efficiency: {efficiency:.2f}")
+                    print(f"  {threads:2d} threads ({threads_used} used): {median_time:.6f}s "
+                          f"(p95 {stats['p95']:.6f}s), speedup: {speedup:.2f}x, efficiency: {efficiency:.2f}")
                 else:
                     print(f"  {threads:2d} threads: FAILED")
     
+    def run_jobs(self, jobs, threads):
+        """
+        Evaluate many integrals in one process through the --jobs stream
+        
+        Args:
+            jobs (list): (x1, x2, dx, method) or (x1, x2, dx, method, integrand) tuples
+            threads (int): Size of the team that runs all jobs
+            
+        Returns:
+            pandas.DataFrame: One row per finished job, ordered by job index, or None on failure
+        """
+        lines = "\n".join(" ".join(str(value) for value in job) for job in jobs) + "\n"
+        result = subprocess.run([self.executable, "--jobs=-", str(threads), f"--reduction={self.reduction}"],
+                                input=lines, capture_output=True, text=True)
+        if result.returncode != 0:
+            print(f"Job stream failed:\n{result.stderr}")
+            return None
+        rows = list(csv.DictReader(result.stdout.strip().splitlines()))
+        df = pd.DataFrame([{key: parse_value(value) for key, value in row.items()} for row in rows])
+        return df.sort_values('job').reset_index(drop=True)
+    
+    def compare_reductions(self, method=5, runs_per_test=3, filename="integration_reduction_results.csv"):
+        """
+        Measure what each reduction strategy costs and how far its area moves with the thread count
+        
+        Args:
+            method (int): Parallel method to compare the strategies on
+            runs_per_test (int): Measured repetitions per configuration
+            filename (str): CSV file for the comparison
+            
+        Returns:
+            pandas.DataFrame: One row per strategy, or None if nothing ran
+        """
+        print(f"\nComparing reduction strategies on {self.methods[method]}")
+        rows = []
+        for reduction in ["naive", "neumaier", "pairwise", "deterministic"]:
+            runs = [self.run_single_test(method, threads, runs_per_test, reduction=reduction)
+                    for threads in self.thread_counts]
+            runs = [run for run in runs if run is not None]
+            if not runs:
+                continue
+            areas = [run['area'] for run in runs]
+            rows.append({
+                'Reduction': reduction,
+                'Median_Time': np.median([run['median'] for run in runs]),
+                'Area_Spread': max(areas) - min(areas),
+                'Distinct_Areas': len(set(areas)),
+                'Error': abs(areas[0] - self.expected_result)
+            })
+        
+        if not rows:
+            return None
+        df = pd.DataFrame(rows)
+        df.to_csv(filename, index=False)
+        print(df.to_string(index=False, float_format='%.3e'))
+        print(f"Reduction comparison saved to {filename}")
+        return df
+    
+    def compare_adaptive(self, threads=4, runs_per_test=3, filename="integration_adaptive_results.csv"):
+        """
+        Compare the samples and error of the adaptive methods with the fixed grid at several accuracies
+        
+        Args:
+            threads (int): Thread count for every run
+            runs_per_test (int): Measured repetitions per configuration
+            filename (str): CSV file for the comparison
+            
+        Returns:
+            pandas.DataFrame: One row per method and tolerance (or step), or None if nothing ran
+        """
+        print(f"\nComparing adaptive and fixed-grid methods with {threads} threads")
+        configs = [(method, tol) for method in (7, 8) for tol in (1e-4, 1e-7, 1e-10)]
+        configs += [(5, step) for step in (1e-2, 1e-3, 1e-4)]
+        rows = []
+        for method, value in configs:
+            stats = self.run_single_test(method, threads, runs_per_test, step=value)
+            if stats is None:
+                continue
+            rows.append({
+                'Method': self.methods[method],
+                'Tolerance_or_Step': value,
+                'Evaluations': stats['evaluations'],
+                'Median_Time': stats['median'],
+                'Error_Estimate': stats['error_estimate'],
+                'Unconverged': stats['unconverged'],
+                'Area': stats['area']
+            })
+        
+        if not rows:
+            return None
+        df = pd.DataFrame(rows)
+        df.to_csv(filename, index=False)
+        print(df.to_string(index=False, float_format='%.3e'))
+        print(f"Adaptive comparison saved to {filename}")
+        return df
+    
+    def plot_time_to_accuracy(self, threads=4, runs_per_test=3, save_plot=True,
+                              csv_filename="integration_accuracy_results.csv",
+                              filename="integration_time_to_accuracy_graph.png"):
+        """
+        Chart the time each rule needs to reach a given error, sweeping dx (or the tolerance of 7/8)
+        
+        Args:
+            threads (int): Thread count for every run
+            runs_per_test (int): Measured repetitions per configuration
+            save_plot (bool): Whether to save the chart
+            csv_filename (str): CSV file for the sweep
+            filename (str): Output file for the chart
+            
+        Returns:
+            pandas.DataFrame: One row per method and dx (or tolerance), or None if nothing ran
+        """
+        if self.integrand != "sin":
+            print("Time-to-accuracy needs the exact area, which is only known for sin")
+            return None
+        exact = np.cos(self.x1) - np.cos(self.x2)
+        
+        print(f"\nTime to accuracy with {threads} threads")
+        sweeps = {method: np.logspace(-1, -5, 9) for method in (6, 9, 10)}
+        sweeps.update({method: np.logspace(-3, -13, 6) for method in (7, 8)})
+        rows = []
+        for method, values in sweeps.items():
+            for value in values:
+                stats = self.run_single_test(method, threads, runs_per_test, step=value)
+                if stats is None:
+                    continue
+                rows.append({
+                    'Method': self.methods[method],
+                    'Step_or_Tolerance': value,
+                    'Evaluations': stats['evaluations'],
+                    'Median_Time': stats['median'],
+                    'Error': abs(stats['area'] - exact)
+                })
+        
+        if not rows:
+            return None
+        df = pd.DataFrame(rows)
+        df.to_csv(csv_filename, index=False)
+        print(f"Time-to-accuracy sweep saved to {csv_filename}")
+        
+        plt.figure(figsize=(12, 8))
+        colors = ['blue', 'red', 'green', 'orange', 'purple']
+        markers = ['o', 's', '^', 'D', 'v']
+        for i, method in enumerate(df['Method'].unique()):
+            method_data = df[df['Method'] == method].sort_values('Median_Time')
+            # Errors that round to zero are drawn at the double precision floor
+            plt.plot(method_data['Median_Time'], np.maximum(method_data['Error'], 1e-17),
+                     color=colors[i], marker=markers[i], linewidth=2, markersize=8, label=method)
+        
+        plt.xlabel('Median Time (seconds)', fontsize=12)
+        plt.ylabel('Absolute Error', fontsize=12)
+        plt.title(f'Time to Accuracy - {threads} Threads\n'
+                 f'Integrating sin(x) from {self.x1} to {self.x2}', fontsize=14)
+        plt.xscale('log')
+        plt.yscale('log')
+        plt.legend(fontsize=11)
+        plt.grid(True, alpha=0.3)
+        
+        plt.tight_layout()
+        
+        if save_plot:
+            plt.savefig(filename, dpi=300, bbox_inches='tight')
+            print(f"Time-to-accuracy graph saved to {filename}")
+        
+        plt.show()
+        return df
+    
+    def compare_monte_carlo(self, threads=4, target=1e-3, runs_per_test=1,
+                            filename="integration_monte_carlo_results.csv"):
+        """
+        Samples and time Monte Carlo and quasi-Monte Carlo need for a target standard error in 2 to 6 dimensions
+        
+        Args:
+            threads (int): Thread count for every run
+            target (float): Target standard error
+            runs_per_test (int): Measured repetitions per configuration
+            filename (str): CSV file for the comparison
+            
+        Returns:
+            pandas.DataFrame: One row per method, sequence and dimension, or None if nothing ran
+        """
+        print(f"\nMonte Carlo against quasi-Monte Carlo, target standard error {target}")
+        rows = []
+        for dimensions in range(2, 7):
+            for method, sequence in [(11, None), (12, "sobol"), (12, "halton")]:
+                extra = [f"--dimensions={dimensions}"] + ([f"--sequence={sequence}"] if sequence else [])
+                stats = self.run_single_test(method, threads, runs_per_test, warmup=0, step=target, extra=extra)
+                if stats is None:
+                    continue
+                # sin becomes the separable product of sin(x_k), whose integral is the 1-D one to the power d
+                exact = (np.cos(self.x1) - np.cos(self.x2)) ** dimensions if self.integrand == "sin" else np.nan
+                rows.append({
+                    'Method': self.methods[method] + (f" {sequence}" if sequence else ""),
+                    'Dimensions': dimensions,
+                    'Evaluations': stats['evaluations'],
+                    'Median_Time': stats['median'],
+                    'Standard_Error': stats['error_estimate'],
+                    'Actual_Error': abs(stats['area'] - exact),
+                    'Unconverged': stats['unconverged']
+                })
+        
+        if not rows:
+            return None
+        df = pd.DataFrame(rows)
+        df.to_csv(filename, index=False)
+        print(df.to_string(index=False, float_format='%.3e'))
+        print(f"Monte Carlo comparison saved to {filename}")
+        return df
+    
+    def compare_cost_model(self, method=5, threads=None, runs_per_test=5,
+                           filename="integration_cost_model_results.csv"):
+        """
+        Time small to large integrals with the fork/join cost model on and off
+        
+        Args:
+            method (int): Parallel fixed-grid method to compare on
+            threads (int): Requested thread count (None = the largest in thread_counts)
+            runs_per_test (int): Measured repetitions per configuration
+            filename (str): CSV file for the comparison
+            
+        Returns:
+            pandas.DataFrame: One row per step size and setting, or None if nothing ran
+        """
+        threads = threads or max(self.thread_counts)
+        print(f"\nCost model on and off with {threads} requested threads")
+        rows = []
+        for step in np.logspace(-2, -8, 7):
+            for setting in ["on", "off"]:
+                stats = self.run_single_test(method, threads, runs_per_test, step=step,
+                                             extra=[f"--cost-model={setting}"])
+                if stats is None:
+                    continue
+                rows.append({
+                    'Step_Size': step,
+                    'Cost_Model': setting,
+                    'Evaluations': stats['evaluations'],
+                    'Threads_Used': stats['threads_used'],
+                    'Median_Time': stats['median']
+                })
+        
+        if not rows:
+            return None
+        df = pd.DataFrame(rows)
+        df.to_csv(filename, index=False)
+        print(df.to_string(index=False, float_format='%.3e'))
+        print(f"Cost model comparison saved to {filename}")
+        return df
+    
+    def sweep_schedules(self, methods=(1, 5), threads=None, runs_per_test=3,
+                        filename="integration_schedule_results.csv"):
+        """
+        Time every chunk loop schedule kind and chunk size (in 32768-sample chunks), with the cost
+        model off so every schedule hands its chunks to the full team
+        
+        Args:
+            methods (tuple): Parallel fixed-grid methods to sweep
+            threads (int): Thread count (None = the largest in thread_counts)
+            runs_per_test (int): Measured repetitions per configuration
+            filename (str): CSV file for the sweep
+            
+        Returns:
+            pandas.DataFrame: One row per method and schedule, or None if nothing ran
+        """
+        threads = threads or max(self.thread_counts)
+        schedules = ["static", "static,1", "dynamic,1", "dynamic,8", "guided", "guided,4", "auto"]
+        print(f"\nSweeping chunk schedules with {threads} threads")
+        rows = []
+        for method in methods:
+            for schedule in schedules:
+                stats = self.run_single_test(method, threads, runs_per_test, schedule=schedule,
+                                             extra=("--cost-model=off",))
+                if stats is None:
+                    continue
+                rows.append({
+                    'Method': self.methods[method],
+                    'Schedule': stats['schedule'],
+                    'Chunk': stats['chunk'],
+                    'Threads_Used': int(stats['threads_used']),
+                    'Median_Time': stats['median'],
+                    'P95': stats['p95'],
+                    'Evals_Per_Sec': stats['evals_per_sec']
+                })
+        
+        if not rows:
+            return None
+        df = pd.DataFrame(rows)
+        df.to_csv(filename, index=False)
+        best = df.loc[df.groupby('Method')['Median_Time'].idxmin()]
+        print("Fastest schedule per method:")
+        print(best.to_string(index=False, float_format='%.3e'))
+        print(f"Schedule sweep saved to {filename}")
+        return df
+    
+    def measure_counters(self, methods=(1, 2, 5, 6, 7, 9, 10), threads=None, runs_per_test=3,
+                         filename="integration_counter_results.csv"):
+        """
+        Measure every method with --counters: IPC and cache misses where the host exposes hardware
+        counters, and per-thread busy time with the resulting load imbalance (busiest thread / mean)
+        
+        Args:
+            methods (tuple): Methods to measure
+            threads (int): Thread count (None = the largest in thread_counts)
+            runs_per_test (int): Measured repetitions per configuration
+            filename (str): CSV file for the counters
+            
+        Returns:
+            pandas.DataFrame: One row per method, or None if nothing ran
+        """
+        threads = threads or max(self.thread_counts)
+        print(f"\nMeasuring hardware counters with {threads} threads")
+        rows = []
+        for method in methods:
+            stats = self.run_single_test(method, threads, runs_per_test, extra=("--counters",))
+            if stats is None:
+                continue
+            rows.append({
+                'Method': self.methods[method],
+                'Median_Time': stats['median'],
+                'Evals_Per_Sec': stats['evals_per_sec'],
+                'IPC': stats['ipc'],
+                'L1D_Misses': stats['l1d_misses'],
+                'LLC_Misses': stats['llc_misses'],
+                'Busy_Mean': stats['busy_mean'],
+                'Busy_Max': stats['busy_max'],
+                'Imbalance': stats['imbalance']
+            })
+        
+        if not rows:
+            return None
+        df = pd.DataFrame(rows)
+        df.to_csv(filename, index=False)
+        print(df.to_string(index=False, float_format='%.3e'))
+        print(f"Counter results saved to {filename}")
+        return df
+    
+    def compare_overheads(self, method=1, runs_per_test=3, filename="integration_overhead_results.csv"):
+        """
+        Split the thread time of every chunk loop region into work, scheduling, fork, barrier and join
+        for each thread count, with the busiest thread's work over the mean (imbalance)
+        
+        Each configuration also writes its Chrome trace timeline to integration_trace_method<method>_<threads>.json,
+        which chrome://tracing or ui.perfetto.dev opens with one track per OpenMP thread.
+        
+        Args:
+            method (int): Method to trace
+            runs_per_test (int): Measured repetitions per configuration
+            filename (str): CSV file for the comparison
+            
+        Returns:
+            pandas.DataFrame: One row per thread count, or None if nothing ran
+        """
+        print(f"\nTracing the parallel regions of {self.methods[method]}")
+        rows = []
+        for threads in self.thread_counts:
+            trace = f"integration_trace_method{method}_{threads}.json"
+            stats = self.run_single_test(method, threads, runs_per_test, extra=(f"--trace={trace}",))
+            if stats is None or 'trace_work' not in stats:
+                continue
+            rows.append({
+                'Threads': threads,
+                'Regions': stats['trace_regions'],
+                'Time': stats['median'],
+                'Work': stats['trace_work'],
+                'Schedule': stats['trace_schedule'],
+                'Fork': stats['trace_fork'],
+                'Barrier': stats['trace_barrier'],
+                'Join': stats['trace_join'],
+                'Imbalance': stats['trace_imbalance']
+            })
+        
+        if not rows:
+            return None
+        df = pd.DataFrame(rows)
+        df.to_csv(filename, index=False)
+        print(df.to_string(index=False, float_format='%.3e'))
+        print(f"Overhead breakdown saved to {filename}")
+        return df
+    
+    def compare_devices(self, methods=(1, 2), device="gpu", runs_per_test=3, filename="integration_device_results.csv",
+                        plot_filename="integration_device_speedup_graph.png"):
+        """
+        Put the host speedup curve of each method next to the same method offloaded with --device
+        
+        Speedups are against the sequential rectangle (method 3). The device runs once per method, its thread
+        count only the label of the run; it is drawn as a horizontal line. Without that device the
+        binary warns and runs the host kernel, and the row's Device column says "host".
+        
+        Args:
+            methods (tuple): Methods to compare (1 and 2 offload)
+            device (str): "gpu" for the default OpenMP device, or a device number
+            runs_per_test (int): Measured repetitions per configuration
+            filename (str): CSV file for the comparison
+            plot_filename (str): Image file for the speedup plot
+            
+        Returns:
+            pandas.DataFrame: One row per method, device and thread count, or None if nothing ran
+        """
+        sequential = self.run_single_test(3, 1, runs_per_test)
+        if sequential is None:
+            return None
+        print(f"\nComparing host and --device={device} runs")
+        rows = []
+        for method in methods:
+            runs = [(threads, ()) for threads in self.thread_counts]
+            runs.append((max(self.thread_counts), (f"--device={device}",)))
+            for threads, extra in runs:
+                stats = self.run_single_test(method, threads, runs_per_test, extra=extra)
+                if stats is None:
+                    continue
+                rows.append({
+                    'Method': self.methods[method],
+                    'Device': stats['device'] if extra else "host",
+                    'Offloaded': bool(extra),
+                    'Threads': threads,
+                    'Time': stats['median'],
+                    'Evals_Per_Sec': stats['evals_per_sec'],
+                    'Speedup': sequential['median'] / stats['median']
+                })
+        
+        if not rows:
+            return None
+        df = pd.DataFrame(rows)
+        df.to_csv(filename, index=False)
+        print(df.to_string(index=False, float_format='%.6f'))
+        print(f"Device comparison saved to {filename}")
+        
+        plt.figure(figsize=(12, 8))
+        for method in methods:
+            name = self.methods[method]
+            host = [row for row in rows if row['Method'] == name and not row['Offloaded']]
+            offloaded = [row for row in rows if row['Method'] == name and row['Offloaded']]
+            if host:
+                plt.plot([row['Threads'] for row in host], [row['Speedup'] for row in host], marker='o',
+                         linewidth=2, markersize=8, label=f'{name} (host)')
+            for row in offloaded:
+                plt.axhline(y=row['Speedup'], linestyle='--', linewidth=2, label=f"{name} ({row['Device']})")
+        plt.xlabel('Number of Host Threads', fontsize=12)
+        plt.ylabel('Speedup', fontsize=12)
+        plt.title('Numerical Integration: Host Threads vs Offloaded Device', fontsize=14)
+        plt.legend(fontsize=11)
+        plt.grid(True, alpha=0.3)
+        plt.xlim(1, max(self.thread_counts))
+        plt.tight_layout()
+        plt.savefig(plot_filename, dpi=300, bbox_inches='tight')
+        print(f"Device plot saved to {plot_filename}")
+        plt.show()
+        return df
+    
     def save_results(self, filename="integration_results.csv"):
         """Save results to CSV file"""
         if self.results:
@@ -204,13 +683,13 @@ class NumericalIntegrationTester:
         
         # Plot speedup for parallel methods only (exclude Sequential)
         parallel_methods = [method for method in df['Method'].unique() if 'OpenMP' in method]
-        colors = ['blue', 'red', 'green']
-        markers = ['o', 's', '^']
+        colors = ['blue', 'red', 'green', 'orange']
+        markers = ['o', 's', '^', 'D']
         
         for i, method in enumerate(parallel_methods):
             method_data = df[df['Method'] == method]
             
-            plt.plot(method_data['Threads'], method_data['Speedup'], 
+            plt.plot(method_data['Threads_Used'], method_data['Speedup'], 
                     color=colors[i], marker=markers[i], linewidth=2, markersize=8,
                     label=f'{method}')
         
@@ -221,7 +700,7 @@ class NumericalIntegrationTester:
                 label='Ideal Speedup', linewidth=1)
         
         # Customize the plot
-        plt.xlabel('Number of Threads', fontsize=12)
+        plt.xlabel('Threads Used', fontsize=12)
         plt.ylabel('Speedup', fontsize=12)
         plt.title(f'Numerical Integration Speedup Comparison\n'
                  f'Integration: sin(x) from {self.x1} to {self.x2:.3f}, '
@@ -234,7 +713,7 @@ class NumericalIntegrationTester:
         # Add annotations for efficiency
         for i, method in enumerate(parallel_methods):
             method_data = df[df['Method'] == method]
-            max_thread_data = method_data[method_data['Threads'] == max_threads]
+            max_thread_data = method_data[method_data['Threads_Used'] == max_threads]
             if not max_thread_data.empty:
                 efficiency = max_thread_data['Efficiency'].iloc[0]
                 speedup = max_thread_data['Speedup'].iloc[0]
@@ -265,13 +744,13 @@ class NumericalIntegrationTester:
         
         # Plot efficiency for parallel methods only
         parallel_methods = [method for method in df['Method'].unique() if 'OpenMP' in method]
-        colors = ['blue', 'red']
-        markers = ['o', 's']
+        colors = ['blue', 'red', 'green', 'orange']
+        markers = ['o', 's', '^', 'D']
         
         for i, method in enumerate(parallel_methods):
             method_data = df[df['Method'] == method]
             if not method_data.empty:
-                plt.plot(method_data['Threads'], method_data['Efficiency'], 
+                plt.plot(method_data['Threads_Used'], method_data['Efficiency'], 
                         color=colors[i], marker=markers[i], linewidth=2, markersize=8,
                         label=f'{method}')
         
@@ -281,7 +760,7 @@ class NumericalIntegrationTester:
                    label='Ideal Efficiency')
         
         # Customize the plot
-        plt.xlabel('Number of Threads', fontsize=12)
+        plt.xlabel('Threads Used', fontsize=12)
         plt.ylabel('Efficiency', fontsize=12)
         plt.title(f'Numerical Integration Efficiency Comparison\n'
                  f'Integration: sin(x) from {self.x1} to {self.x2:.3f}, '
@@ -314,8 +793,8 @@ class NumericalIntegrationTester:
         df['Relative_Error'] = abs(df['Area'] - self.expected_result) / self.expected_result * 100
         
         methods = df['Method'].unique()
-        colors = ['blue', 'red', 'green', 'orange']
-        markers = ['o', 's', '^', 'D']
+        colors = ['blue', 'red', 'green', 'orange', 'purple', 'brown']
+        markers = ['o', 's', '^', 'D', 'v', 'P']
         
         for i, method in enumerate(methods):
             method_data = df[df['Method'] == method]
@@ -325,12 +804,12 @@ class NumericalIntegrationTester:
                            color=colors[i], marker=markers[i], s=100, label=method)
             else:
                 # Parallel methods: line plot
-                plt.plot(method_data['Threads'], method_data['Relative_Error'], 
+                plt.plot(method_data['Threads_Used'], method_data['Relative_Error'], 
                         color=colors[i], marker=markers[i], linewidth=2, markersize=8,
                         label=method)
         
         # Customize the plot
-        plt.xlabel('Number of Threads', fontsize=12)
+        plt.xlabel('Threads Used', fontsize=12)
         plt.ylabel('Relative Error (%)', fontsize=12)
         plt.title(f'Numerical Integration Accuracy Comparison\n'
                  f'Expected Result: {self.expected_result}', fontsize=14)
@@ -353,7 +832,7 @@ def main():
     X1 = 0.0
     X2 = 3.14159  # π
     DX = 0.0001   # Small step size for good accuracy and reasonable computation time
-    RUNS_PER_TEST = 3  # Average over 3 runs for better accuracy
+    RUNS_PER_TEST = 10  # Measured repetitions per configuration, reported as the median
     
     print("Numerical Integration Performance Testing")
     print("=" * 50)
@@ -381,6 +860,15 @@ def main():
             tester.plot_speedup()
             tester.plot_efficiency()
             tester.plot_accuracy_comparison()
+            tester.compare_reductions()
+            tester.compare_adaptive()
+            tester.plot_time_to_accuracy()
+            tester.compare_monte_carlo()
+            tester.sweep_schedules()
+            tester.compare_cost_model()
+            tester.measure_counters()
+            tester.compare_overheads()
+            tester.compare_devices()
             
             print("\nTesting completed successfully!")
         else:
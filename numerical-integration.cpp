@@ -5,20 +5,261 @@
 #include <list>
 #include <utility>
 #include <exception>
+#include <stdexcept>
 #include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cctype>
+#include <limits>
+#include <map>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <memory>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_X86_SIMD_KERNELS 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FORCE_INLINE inline __attribute__((always_inline))
+#else
+#define FORCE_INLINE inline
+#endif
+
+#include "common.hpp"
 
 using namespace std;
 
 struct Result
 {
 	double timestamp, area;
+	long long evaluations;  // integrand evaluations performed
+	double error;           // adaptive methods: estimated absolute error, 0 otherwise
+	int unconverged;        // adaptive methods: subintervals accepted at the depth limit
+};
+
+// Outcome of refining one subinterval in the adaptive methods
+struct AdaptiveResult
+{
+	double area, error;
+	long long evaluations;
+	int unconverged;
+};
+
+// How the parallel methods combine their chunk sums (see chunkedSum)
+enum Reduction { naiveReduction, neumaierReduction, pairwiseReduction, deterministicReduction };
+
+// Loop schedule handed to the schedule(runtime) chunk loops; chunk 0 keeps the default
+struct Schedule
+{
+	omp_sched_t kind;
+	int chunk;
+};
+
+// Points of the Monte Carlo methods: counter-based pseudo-random (method 11)
+// or a randomly shifted low-discrepancy sequence (method 12)
+enum Sampling { pseudoRandomSampling, sobolSampling, haltonSampling };
+
+// Highest dimension of the Monte Carlo methods, set by the Sobol direction numbers
+const int maxDimensions = 6;
+
+struct Integrand;
+
+// Sum of f(x1 + i * dx) for the count samples i = first, first + 1, ...
+typedef double (*ChunkSum)(const Integrand& f, double x1, double dx, long long first, long long count);
+
+// Instruction set the vector kernels are compiled for; level indexes Integrand::simd
+struct SimdKernel
+{
+	const char* name;
+	int lanes;
+	int level;
+};
+
+// Postfix program compiled from a user expression in x. The SIMD kernels run
+// it a block of samples at a time, so every instruction is one vector loop.
+struct Expression
+{
+	enum Code { variable, constant, add, subtract, multiply, divide, power, integerPower, negate,
+	            sine, cosine, exponential, logarithm, squareRoot, absolute };
+	struct Instruction
+	{
+		Code code;
+		double value;  // constant value, the exponent of integerPower, or the coordinate index of variable
+	};
+	static const int maxDepth = 16;
+
+	vector<Instruction> program;
+	int dimensions = 1;  // coordinates the program reads: x (= x1) up to x6
+};
+
+// Integrand chosen with --integrand: its parameters plus the kernels
+// instantiated for its functor, so no per-sample indirect call remains
+struct Integrand
+{
+	string name;
+	vector<double> coefficients;  // polynomial, constant term first
+	Expression expression;        // user expression
+	double simdLimit;             // methods 5/6 use the scalar kernels once |x| reaches it
+	double (*value)(const Integrand& f, double x);  // one libm evaluation
+	ChunkSum scalar;              // libm loop for methods 1-4
+	ChunkSum simd[3];             // vector loops by SimdKernel::level
+};
+
+// Optional settings given after the positional batch arguments
+struct Options
+{
+	int warmup = 1;              // benchmark mode: untimed runs before measuring
+	int reps = 0;                // benchmark mode: measured runs, 0 = single run with the plain CSV line
+	bool counters = false;       // benchmark mode: perf_event counters around each measured run
+	const char* trace = nullptr; // batch mode: Chrome trace file of the chunk loops' parallel regions
+	int device = -1;             // OpenMP device that methods 1 and 2 are offloaded to, -1 = the host kernels
+	const char* format = "csv";  // benchmark report format: csv or json
+	const char* kernel = "auto"; // SIMD kernel for methods 5/6: auto, avx512, avx2 or generic
+	Reduction reduction = neumaierReduction;  // how methods 1, 2, 5 and 6 combine their chunk sums
+	Schedule schedule = { omp_sched_dynamic, 1 };  // how the chunk loops hand out chunks
+	Integrand integrand;         // --integrand, sin unless given
+	int taskDepth = 0;           // adaptive methods: levels refined as tasks, 0 = enough for all threads
+	int maxDepth = 50;           // adaptive methods: deepest subdivision before giving up on a subinterval
+	int gaussPoints = 5;         // method 10: Gauss-Legendre nodes per panel
+	int dimensions = 1;          // methods 11/12: integrate over the cube [x1, x2]^dimensions
+	Sampling sequence = sobolSampling;  // method 12: sobol or halton
+	long long maxSamples = 1LL << 30;   // methods 11/12: stop here even above the target error
+	uint64_t seed = 1;           // methods 11/12: random stream and sequence shifts
+	bool progress = false;       // methods 11/12: print every round's estimate to stderr
+	bool costModel = false;      // let the cost model shrink or skip the team of small problems
+	bool recalibrate = false;    // measure the fork/join cost even when the calibration file has it
+	const char* calibrationFile = "numerical-integration.calibration";
+};
+
+// Fork/join cost model of the chunk loops (opt-in with --cost-model=on): a
+// team of p threads only pays off when the time it saves on the remaining
+// chunks exceeds the cost of waking it. That cost is measured once per host
+// and team size and kept in the calibration file. main and the server
+// calibrate the team sizes a run may use before timing anything, so the
+// kernels only look the costs up; runMethod switches the model on from the
+// options, like the schedule.
+struct CostModel
+{
+	bool enabled = false;
+	int largestTeam = 1;        // widest team the current method has used
+	map<int, double> forkJoin;  // seconds per parallel region, by team size
+	bool loaded = false;
+
+	void calibrate(int maxThreads, const char* file, bool recalibrate);
+	int threadsFor(long long chunks, double chunkTime, int maxThreads) const;
+	void useTeam(int threads) { largestTeam = max(largestTeam, threads); }
+	static vector<int> teamSizes(int maxThreads);
+};
+
+static CostModel costModel;
+
+// The integrand's coefficients mapped to an OpenMP device for a whole batch,
+// so the offloaded methods find them present instead of copying them per run
+struct DeviceCoefficients
+{
+	DeviceCoefficients(const vector<double>& coefficients, int device);
+	~DeviceCoefficients();
+
+	const double* c;
+	int terms, device;
+};
+
+// One line of a --jobs stream: an integral with its own interval, method and integrand
+struct Job
+{
+	long long index;
+	double x1, x2, dx;
+	short method;
+	Options options;  // the command line options with this job's integrand
+};
+
+// n-point Gauss-Legendre rule on [-1, 1], exact for polynomials of degree 2n - 1
+struct GaussRule
+{
+	vector<double> nodes, weights;
+};
+
+// Neumaier-compensated running sum: the rounding error of every addition is
+// kept in compensation, whichever operand is larger
+struct CompensatedSum
+{
+	double sum = 0.0, compensation = 0.0;
+
+	void add(double value);
+	void merge(const CompensatedSum& other) { add(other.sum); add(other.compensation); }
+	double total() const { return sum + compensation; }
+};
+
+// Uncompensated running sum, the behaviour of reduction(+: s)
+struct PlainSum
+{
+	double sum = 0.0;
+
+	void add(double value) { sum += value; }
+	void merge(const PlainSum& other) { sum += other.sum; }
+	double total() const { return sum; }
+};
+
+// Streaming pairwise sum: level[k] holds the sum of 2^k consecutive values
+// and levels merge like the bits of a binary counter, so the error grows
+// with log(count) while only one value per level is stored
+struct PairwiseSum
+{
+	double level[64];
+	long long count = 0;
+
+	void add(double value);
+	void merge(const PairwiseSum& other) { add(other.total()); }
+	double total() const;
 };
 
-double f(const double x);
-const Result rectangleMethod(const double, const double, const double, const int);
-const Result trapezoidalMethod(const double, const double, const double, const int);
-const Result sequentialRectangleMethod(const double, const double, const double);
-const Result sequentialTrapezoidalMethod(const double, const double, const double);
+bool parseOption(const char* arg, Options& options);
+const Result runMethod(short method, const double x1, const double x2, const double dx, const int nThreads,
+                       const Options& options);
+const SimdKernel& selectSimdKernel(const char* name);
+void addCounterFields(vector<ReportField>& report, const KernelCounters& counters, int runs, int team);
+bool parseDevice(const char* text, int& device);
+string deviceName(int device);
+int runJobs(const char* path, const int nThreads, const Options& options);
+int serve(const char* path, const Options& options);
+bool parseIntegrand(const char* text, Integrand& f);
+long long sampleCount(const double x1, const double x2, const double dx);
+double chunkedSum(const Integrand& f, const double x1, const double dx, long long first, long long last,
+                  const int nThreads, ChunkSum sum, Reduction reduction);
+double pairwiseSum(const double* values, long long count);
+bool parseReduction(const char* name, Reduction& reduction);
+bool parseSchedule(const char* text, Schedule& schedule);
+const char* scheduleName(const Schedule& schedule);
+const char* reductionName(Reduction reduction);
+const Result rectangleMethod(const double, const double, const double, const int, const Integrand&, Reduction);
+const Result trapezoidalMethod(const double, const double, const double, const int, const Integrand&, Reduction);
+const Result offloadedRectangleMethod(const double, const double, const double, const Integrand&, int);
+const Result offloadedTrapezoidalMethod(const double, const double, const double, const Integrand&, int);
+const Result sequentialRectangleMethod(const double, const double, const double, const Integrand&);
+const Result sequentialTrapezoidalMethod(const double, const double, const double, const Integrand&);
+const Result simdRectangleMethod(const double, const double, const double, const int, const Integrand&,
+                                 const SimdKernel&, Reduction);
+const Result simdTrapezoidalMethod(const double, const double, const double, const int, const Integrand&,
+                                   const SimdKernel&, Reduction);
+const Result adaptiveSimpsonMethod(const double, const double, const double, const int, const Integrand&, int, int);
+const Result adaptiveKronrodMethod(const double, const double, const double, const int, const Integrand&, int, int);
+const Result simpsonMethod(const double, const double, const double, const int, const Integrand&, ChunkSum, Reduction);
+const Result gaussLegendreMethod(const double, const double, const double, const int, const Integrand&, ChunkSum,
+                                 Reduction, const GaussRule&);
+const GaussRule gaussLegendreRule(int points);
+const Result monteCarloMethod(const double, const double, const double, const int, const Integrand&, Sampling,
+                              const Options&);
 
 int main(int argc, char* argv[])
 {
@@ -27,15 +268,54 @@ int main(int argc, char* argv[])
 	double x1, x2, dx;
 	bool batchMode = false;
 	int specificThreads = 0;
+	Options options;
+	parseIntegrand("sin", options.integrand);
+
+	// Server mode: --serve=<socket path> [--option=value ...]
+	if (argc >= 2 && strncmp(argv[1], "--serve=", 8) == 0)
+	{
+		for (int i = 2; i < argc; i++)
+		{
+			if (!parseOption(argv[i], options))
+			{
+				cout << "Error: invalid option " << argv[i] << endl;
+				return 1;
+			}
+		}
+		return serve(argv[1] + 8, options);
+	}
 
-	// Check for command line arguments: x1 x2 dx method threads
-	if (argc == 6) {
+	// Job stream: --jobs=<file or -> threads [--option=value ...]
+	if (argc >= 3 && strncmp(argv[1], "--jobs=", 7) == 0)
+	{
+		for (int i = 3; i < argc; i++)
+		{
+			if (!parseOption(argv[i], options))
+			{
+				cout << "Error: invalid option " << argv[i] << endl;
+				return 1;
+			}
+		}
+		return runJobs(argv[1] + 7, max(1, atoi(argv[2])), options);
+	}
+
+	// Check for command line arguments: x1 x2 dx method threads [--option=value ...]
+	if (argc >= 6) {
 		x1 = atof(argv[1]);
 		x2 = atof(argv[2]);
 		dx = atof(argv[3]);
 		method = atoi(argv[4]);
 		specificThreads = atoi(argv[5]);
 		batchMode = true;
+
+		for (int i = 6; i < argc; i++)
+		{
+			if (!parseOption(argv[i], options))
+			{
+				cout << "Error: invalid option " << argv[i] << endl;
+				return 1;
+			}
+		}
 	}
 
 	cout << fixed << setprecision(8) << endl;
@@ -47,27 +327,92 @@ int main(int argc, char* argv[])
 				cout << "   X1: "; cin >> x1;
 				cout << "   X2: "; cin >> x2;
 				cout << "   dx: "; cin >> dx;
-				cout << "   Method (1 - rectangle, 2 - trapezoidal, 3 - sequential rectangle, 4 - sequential trapezoidal): "; cin >> method;
+				cout << "   Method (1 - rectangle, 2 - trapezoidal, 3 - sequential rectangle, 4 - sequential trapezoidal, 5 - simd rectangle, 6 - simd trapezoidal, 7 - adaptive simpson, 8 - adaptive gauss-kronrod, 9 - simpson, 10 - gauss-legendre, 11 - monte carlo, 12 - quasi-monte carlo): "; cin >> method;
+			}
+		}
+		
+		// Offload: methods 1 and 2 only, and the host kernels when the device does not exist
+		if (options.device >= 0)
+		{
+			if ((method != 1 && method != 2) || options.integrand.name == "expr" || !batchMode || specificThreads <= 0)
+				throw invalid_argument("--device offloads methods 1 and 2 in batch mode, for the built-in integrands");
+			if (options.device >= omp_get_num_devices())
+			{
+				cerr << "Warning: no OpenMP device " << options.device << " (" << omp_get_num_devices()
+				     << " available), method " << method << " runs on the host" << endl;
+				options.device = -1;
 			}
 		}
+		unique_ptr<DeviceCoefficients> onDevice(options.device >= 0 ?
+		                                        new DeviceCoefficients(options.integrand.coefficients, options.device) :
+		                                        nullptr);
+
+		// Measure the fork/join costs of every team a run may use now, not inside a timed run
+		if (options.costModel)
+		{
+			// Batch mode without a positive thread count runs every team up to maxThreads, like interactive mode
+			const bool oneTeam = batchMode && specificThreads > 0;
+			const int fewest = oneTeam ? specificThreads : 1, most = oneTeam ? specificThreads : maxThreads;
+			for (int threads = fewest; threads <= most; threads++)
+				costModel.calibrate(threads, options.calibrationFile, options.recalibrate);
+		}
 		
 		// Common execution logic for both interactive and batch mode
 		do {
 			if (batchMode && specificThreads > 0) {
 				// Batch mode: run with specific thread count
-				Result result;
-				if (method == 3) {
-					result = sequentialRectangleMethod(x1, x2, dx);
-				} else if (method == 4) {
-					result = sequentialTrapezoidalMethod(x1, x2, dx);
-				} else if (method == 1) {
-					result = rectangleMethod(x1, x2, dx, specificThreads);
-				} else {
-					result = trapezoidalMethod(x1, x2, dx, specificThreads);
+				if (options.reps > 0) {
+					// Benchmark mode: warm up, then time each repetition in this process
+					vector<double> times;
+					Result result;
+					int threadsUsed = 1;
+					unique_ptr<KernelCounters> counters(options.counters ? new KernelCounters(specificThreads) : nullptr);
+					tracer.origin = omp_get_wtime();
+					tracer.timeline = options.trace != nullptr;
+					for (int run = 0; run < options.warmup + options.reps; run++)
+					{
+						const bool measured = run >= options.warmup;
+						tracer.enabled = (options.trace || counters) && measured;
+						if (measured && counters) counters->start();
+						result = runMethod(method, x1, x2, dx, specificThreads, options);
+						if (measured && counters) counters->stop();
+						threadsUsed = costModel.largestTeam;
+						if (measured) times.push_back(result.timestamp);
+					}
+					tracer.enabled = false;
+
+					const Statistics stats = summarize(times);
+					vector<ReportField> report = {
+						field("method", method), field("threads", specificThreads), field("x1", x1), field("x2", x2),
+						field("dx", dx), field("warmup", options.warmup), field("reps", options.reps),
+						field("area", result.area), field("evaluations", result.evaluations),
+						field("min", stats.min), field("median", stats.median), field("p95", stats.p95),
+						field("mean", stats.mean), field("stddev", stats.stddev),
+						field("evals_per_sec", result.evaluations / stats.median),
+						field("reduction", string(reductionName(options.reduction))),
+						field("integrand", options.integrand.name),
+						field("error_estimate", result.error), field("unconverged", result.unconverged),
+						field("dimensions", options.dimensions),
+						field("schedule", string(scheduleName(options.schedule))), field("chunk", options.schedule.chunk),
+						field("threads_used", threadsUsed), field("device", deviceName(options.device))
+					};
+					if (counters) addCounterFields(report, *counters, options.reps, threadsUsed);
+					if (options.trace) addTraceFields(report);
+					printReport(cout, report, options.format);
+					if (options.trace) reportTrace(options.trace);
+					return 0;
 				}
+
+				tracer.origin = omp_get_wtime();
+				tracer.timeline = options.trace != nullptr;
+				tracer.enabled = options.trace;
+				Result result = runMethod(method, x1, x2, dx, specificThreads, options);
+				tracer.enabled = false;
 				
-				// Output in CSV format for Python parsing
-				cout << method << "," << specificThreads << "," << fixed << setprecision(8) << result.timestamp << "," << result.area << endl;
+				// Output in CSV format for Python parsing: the requested team, then the one the cost model used
+				cout << method << "," << specificThreads << "," << fixed << setprecision(8) << result.timestamp << ","
+				     << result.area << "," << costModel.largestTeam << endl;
+				if (options.trace) reportTrace(options.trace);
 				return 0;
 			}
 			else {
@@ -76,18 +421,14 @@ int main(int argc, char* argv[])
 				
 				if (method == 3 || method == 4) {
 					// Sequential methods - run only once
-					Result result = (method == 3) ?
-						sequentialRectangleMethod(x1, x2, dx) :
-						sequentialTrapezoidalMethod(x1, x2, dx);
+					Result result = runMethod(method, x1, x2, dx, 1, options);
 					pair<short, Result> s_result(1, result);
 					results.push_back(s_result);
 				} else {
 					// Parallel methods - run with 1-maxThreads threads
 					for (int i = 0; i < maxThreads; i++)
 					{
-						Result result = (method == 1) ?
-							rectangleMethod(x1, x2, dx, i + 1) :
-							trapezoidalMethod(x1, x2, dx, i + 1);
+						Result result = runMethod(method, x1, x2, dx, i + 1, options);
 
 						pair<short, Result> s_result(i + 1, result);
 						results.push_back(s_result);
@@ -113,63 +454,1834 @@ int main(int argc, char* argv[])
 	return 0;
 }
 
-const Result rectangleMethod(const double x1, const double x2, const double dx, const int nThreads)
+bool parseOption(const char* arg, Options& options)
+{
+	if (strncmp(arg, "--warmup=", 9) == 0) options.warmup = max(0, atoi(arg + 9));
+	else if (strncmp(arg, "--reps=", 7) == 0) options.reps = max(0, atoi(arg + 7));
+	else if (strcmp(arg, "--counters") == 0) options.counters = true;
+	else if (strncmp(arg, "--trace=", 8) == 0) options.trace = arg + 8;
+	else if (strncmp(arg, "--device=", 9) == 0) return parseDevice(arg + 9, options.device);
+	else if (strncmp(arg, "--kernel=", 9) == 0) options.kernel = arg + 9;
+	else if (strncmp(arg, "--integrand=", 12) == 0) return parseIntegrand(arg + 12, options.integrand);
+	else if (strncmp(arg, "--task-depth=", 13) == 0) options.taskDepth = max(0, atoi(arg + 13));
+	else if (strncmp(arg, "--max-depth=", 12) == 0) options.maxDepth = max(1, atoi(arg + 12));
+	else if (strncmp(arg, "--gauss-points=", 15) == 0)
+	{
+		options.gaussPoints = atoi(arg + 15);
+		return options.gaussPoints >= 1 && options.gaussPoints <= 64;
+	}
+	else if (strncmp(arg, "--dimensions=", 13) == 0)
+	{
+		options.dimensions = atoi(arg + 13);
+		return options.dimensions >= 1 && options.dimensions <= maxDimensions;
+	}
+	else if (strcmp(arg, "--sequence=sobol") == 0) options.sequence = sobolSampling;
+	else if (strcmp(arg, "--sequence=halton") == 0) options.sequence = haltonSampling;
+	else if (strncmp(arg, "--max-samples=", 14) == 0) options.maxSamples = max(1LL, atoll(arg + 14));
+	else if (strncmp(arg, "--seed=", 7) == 0) options.seed = strtoull(arg + 7, nullptr, 10);
+	else if (strcmp(arg, "--progress") == 0) options.progress = true;
+	else if (strncmp(arg, "--reduction=", 12) == 0) return parseReduction(arg + 12, options.reduction);
+	else if (strncmp(arg, "--schedule=", 11) == 0) return parseSchedule(arg + 11, options.schedule);
+	else if (strcmp(arg, "--cost-model=on") == 0) options.costModel = true;
+	else if (strcmp(arg, "--cost-model=off") == 0) options.costModel = false;
+	else if (strcmp(arg, "--recalibrate") == 0) options.recalibrate = true;
+	else if (strncmp(arg, "--calibration-file=", 19) == 0) options.calibrationFile = arg + 19;
+	else if (strncmp(arg, "--format=", 9) == 0)
+	{
+		options.format = arg + 9;
+		return strcmp(options.format, "csv") == 0 || strcmp(options.format, "json") == 0;
+	}
+	else return false;
+	return true;
+}
+
+// Largest |x| for which simdSin and simdExp are accurate
+const double simdSinLimit = 1e9;
+
+// The chunk loops (chunkedSum and the Monte Carlo rounds) are
+// schedule(runtime) and consult costModel, so the --schedule and cost model
+// choices set here reach them all
+const Result runMethod(short method, const double x1, const double x2, const double dx, const int nThreads,
+                       const Options& options)
+{
+	omp_set_schedule(options.schedule.kind, options.schedule.chunk);
+	costModel.enabled = options.costModel;
+	costModel.largestTeam = 1;
+	const Integrand& f = options.integrand;
+	if (method <= 10 && f.expression.dimensions > 1)
+		throw invalid_argument("The integrand uses x2 or later, which only methods 11 and 12 integrate");
+	const bool simdInRange = max(abs(x1), abs(x2)) < f.simdLimit;
+	// The higher-order rules use the vector kernel wherever it is accurate
+	const ChunkSum fastest = simdInRange ? f.simd[selectSimdKernel(options.kernel).level] : f.scalar;
+	switch (method)
+	{
+	case 1:
+		if (options.device >= 0) return offloadedRectangleMethod(x1, x2, dx, f, options.device);
+		return rectangleMethod(x1, x2, dx, nThreads, f, options.reduction);
+	case 2:
+		if (options.device >= 0) return offloadedTrapezoidalMethod(x1, x2, dx, f, options.device);
+		return trapezoidalMethod(x1, x2, dx, nThreads, f, options.reduction);
+	case 3: return sequentialRectangleMethod(x1, x2, dx, f);
+	case 4: return sequentialTrapezoidalMethod(x1, x2, dx, f);
+	case 5:
+		if (!simdInRange) return rectangleMethod(x1, x2, dx, nThreads, f, options.reduction);
+		return simdRectangleMethod(x1, x2, dx, nThreads, f, selectSimdKernel(options.kernel), options.reduction);
+	case 6:
+		if (!simdInRange) return trapezoidalMethod(x1, x2, dx, nThreads, f, options.reduction);
+		return simdTrapezoidalMethod(x1, x2, dx, nThreads, f, selectSimdKernel(options.kernel), options.reduction);
+	// Adaptive methods read the dx argument as the absolute error tolerance
+	case 7: return adaptiveSimpsonMethod(x1, x2, dx, nThreads, f, options.taskDepth, options.maxDepth);
+	case 8: return adaptiveKronrodMethod(x1, x2, dx, nThreads, f, options.taskDepth, options.maxDepth);
+	case 9: return simpsonMethod(x1, x2, dx, nThreads, f, fastest, options.reduction);
+	case 10:
+		return gaussLegendreMethod(x1, x2, dx, nThreads, f, fastest, options.reduction,
+		                           gaussLegendreRule(options.gaussPoints));
+	// Monte Carlo methods read the dx argument as the target standard error
+	case 11: return monteCarloMethod(x1, x2, dx, nThreads, f, pseudoRandomSampling, options);
+	case 12: return monteCarloMethod(x1, x2, dx, nThreads, f, options.sequence, options);
+	default: throw invalid_argument("Unknown method");
+	}
+}
+
+// Per-run averages of the counters over the threads of the largest team.
+// Busy time is the work time of each thread and imbalance the busiest
+// thread over the mean (1 = perfectly even).
+void addCounterFields(vector<ReportField>& report, const KernelCounters& counters, int runs, int team)
+{
+	const double cycles = counters.total(KernelCounters::cycles) / runs;
+	const double instructions = counters.total(KernelCounters::instructions) / runs;
+	team = max(1, min(team, counters.nThreads));
+	double busyMean = 0.0, busyMax = 0.0;
+	for (int thread = 0; thread < team; thread++)
+	{
+		const double busy = counters.busy(thread) / runs;
+		busyMean += busy / team;
+		busyMax = std::isnan(busy) ? busy : max(busyMax, busy);
+	}
+
+	report.push_back(field("cycles", cycles));
+	report.push_back(field("instructions", instructions));
+	report.push_back(field("ipc", instructions / cycles));
+	report.push_back(field("l1d_misses", counters.total(KernelCounters::l1dMisses) / runs));
+	report.push_back(field("llc_misses", counters.total(KernelCounters::llcMisses) / runs));
+	report.push_back(field("busy_mean", busyMean));
+	report.push_back(field("busy_max", busyMax));
+	report.push_back(field("imbalance", busyMax / busyMean));
+}
+
+const Result rectangleMethod(const double x1, const double x2, const double dx, const int nThreads,
+                             const Integrand& f, Reduction reduction)
 {
-	const int N = static_cast<int>((x2 - x1) / dx);
+	const long long N = sampleCount(x1, x2, dx);
 	double now = omp_get_wtime();
-	double s = 0;
 
-	#pragma omp parallel for num_threads(nThreads) reduction(+: s)
-	for (int i = 1; i <= N; i++) s += f(x1 + i * dx);
+	const double s = chunkedSum(f, x1, dx, 1, N + 1, nThreads, f.scalar, reduction) * dx;
 
-	s *= dx;
-	 
-	return { omp_get_wtime() - now, s };
+	return { omp_get_wtime() - now, s, N, 0.0, 0 };
 }
 
-const Result trapezoidalMethod(const double x1, const double x2, const double dx, const int nThreads)
+const Result trapezoidalMethod(const double x1, const double x2, const double dx, const int nThreads,
+                               const Integrand& f, Reduction reduction)
 {
-	const int N = static_cast<int>((x2 - x1) / dx);
+	const long long N = sampleCount(x1, x2, dx);
 	double now = omp_get_wtime();
-	double s = 0;
 
-	#pragma omp parallel for num_threads(nThreads) reduction(+: s)
-	for (int i = 1; i < N; i++) s += f(x1 + i * dx);
+	double s = chunkedSum(f, x1, dx, 1, N, nThreads, f.scalar, reduction);
+	s = (s + (f.value(f, x1) + f.value(f, x2)) / 2) * dx;
 
-	s = (s + (f(x1) + f(x2)) / 2) * dx;
-	 
-	return { omp_get_wtime() - now, s };
+	return { omp_get_wtime() - now, s, max(N - 1, 0LL) + 2, 0.0, 0 };
+}
+
+// Sum of f(x1 + i * dx) for i in [first, last) on an OpenMP device, as one
+// teams reduction that the device combines in its own order, so --reduction
+// does not apply. The built-in integrand is picked inside the loop (the same
+// branch for every sample): libm sin and exp, or Horner's rule over the
+// coefficients, which DeviceCoefficients has usually made resident already.
+static double offloadedSum(const Integrand& f, const double x1, const double dx, long long first, long long last,
+                           int device)
+{
+	const int kind = f.name == "sin" ? 0 : f.name == "exp" ? 1 : f.name == "gaussian" ? 2 : 3;
+	const double* c = f.coefficients.data();
+	const int terms = static_cast<int>(f.coefficients.size());
+	double s = 0.0;
+
+	#pragma omp target teams distribute parallel for reduction(+: s) device(device) map(to: c[0:terms]) \
+		map(tofrom: s)
+	for (long long i = first; i < last; i++)
+	{
+		const double x = x1 + i * dx;
+		double y = 0.0;
+		if (kind == 0) y = sin(x);
+		else if (kind == 1) y = exp(x);
+		else if (kind == 2) y = exp(-x * x);
+		else
+			for (int k = terms - 1; k >= 0; k--) y = y * x + c[k];
+		s += y;
+	}
+	return s;
 }
 
-const Result sequentialRectangleMethod(const double x1, const double x2, const double dx)
+// Methods 1 and 2 with --device: the same samples as the host kernels
+const Result offloadedRectangleMethod(const double x1, const double x2, const double dx, const Integrand& f,
+                                      int device)
 {
-	const int N = static_cast<int>((x2 - x1) / dx);
+	const long long N = sampleCount(x1, x2, dx);
+	double now = omp_get_wtime();
+
+	const double s = offloadedSum(f, x1, dx, 1, N + 1, device) * dx;
+
+	return { omp_get_wtime() - now, s, N, 0.0, 0 };
+}
+
+const Result offloadedTrapezoidalMethod(const double x1, const double x2, const double dx, const Integrand& f,
+                                        int device)
+{
+	const long long N = sampleCount(x1, x2, dx);
+	double now = omp_get_wtime();
+
+	double s = offloadedSum(f, x1, dx, 1, N, device);
+	s = (s + (f.value(f, x1) + f.value(f, x2)) / 2) * dx;
+
+	return { omp_get_wtime() - now, s, max(N - 1, 0LL) + 2, 0.0, 0 };
+}
+
+DeviceCoefficients::DeviceCoefficients(const vector<double>& coefficients, int device)
+	: c(coefficients.data()), terms(static_cast<int>(coefficients.size())), device(device)
+{
+	#pragma omp target enter data device(device) map(to: c[0:terms])
+}
+
+DeviceCoefficients::~DeviceCoefficients()
+{
+	#pragma omp target exit data device(device) map(release: c[0:terms])
+}
+
+const Result sequentialRectangleMethod(const double x1, const double x2, const double dx, const Integrand& f)
+{
+	const long long N = sampleCount(x1, x2, dx);
 	double now = omp_get_wtime();
-	double s = 0;
 
 	// Pure sequential - no OpenMP directives
-	for (int i = 1; i <= N; i++) s += f(x1 + i * dx);
+	double s = f.scalar(f, x1, dx, 1, N);
 
 	s *= dx;
 	 
-	return { omp_get_wtime() - now, s };
+	return { omp_get_wtime() - now, s, N, 0.0, 0 };
 }
 
-const Result sequentialTrapezoidalMethod(const double x1, const double x2, const double dx)
+const Result sequentialTrapezoidalMethod(const double x1, const double x2, const double dx, const Integrand& f)
 {
-	const int N = static_cast<int>((x2 - x1) / dx);
+	const long long N = sampleCount(x1, x2, dx);
 	double now = omp_get_wtime();
-	double s = 0;
 
 	// Pure sequential - no OpenMP directives
-	for (int i = 1; i < N; i++) s += f(x1 + i * dx);
+	double s = f.scalar(f, x1, dx, 1, max(N - 1, 0LL));
 
-	s = (s + (f(x1) + f(x2)) / 2) * dx;
+	s = (s + (f.value(f, x1) + f.value(f, x2)) / 2) * dx;
 	 
-	return { omp_get_wtime() - now, s };
+	return { omp_get_wtime() - now, s, max(N - 1, 0LL) + 2, 0.0, 0 };
+}
+
+// Number of dx steps in [x1, x2], as a 64-bit count so fine grids past 2^31
+// samples stay exact (doubles index samples exactly up to 2^53)
+long long sampleCount(const double x1, const double x2, const double dx)
+{
+	return static_cast<long long>((x2 - x1) / dx);
+}
+
+void CompensatedSum::add(double value)
+{
+	const double t = sum + value;
+	if (abs(sum) >= abs(value)) compensation += (sum - t) + value;
+	else compensation += (value - t) + sum;
+	sum = t;
+}
+
+void PairwiseSum::add(double value)
+{
+	// Every trailing one bit of count is a full level to merge the new value into
+	int k = 0;
+	for (long long n = count; n & 1; n >>= 1) value = level[k++] + value;
+	level[k] = value;
+	count++;
+}
+
+double PairwiseSum::total() const
+{
+	double s = 0.0;
+	int k = 0;
+	for (long long n = count; n; n >>= 1, k++)
+		if (n & 1) s += level[k];
+	return s;
+}
+
+// Tree sum of values[0, count) with a fixed split, so the result only
+// depends on the values and their order
+double pairwiseSum(const double* values, long long count)
+{
+	if (count <= 8)
+	{
+		double s = 0.0;
+		for (long long i = 0; i < count; i++) s += values[i];
+		return s;
+	}
+	const long long half = count / 2;
+	return pairwiseSum(values, half) + pairwiseSum(values + half, count - half);
+}
+
+bool parseReduction(const char* name, Reduction& reduction)
+{
+	if (strcmp(name, "naive") == 0) reduction = naiveReduction;
+	else if (strcmp(name, "neumaier") == 0 || strcmp(name, "kahan") == 0) reduction = neumaierReduction;
+	else if (strcmp(name, "pairwise") == 0) reduction = pairwiseReduction;
+	else if (strcmp(name, "deterministic") == 0) reduction = deterministicReduction;
+	else return false;
+	return true;
+}
+
+const char* reductionName(Reduction reduction)
+{
+	switch (reduction)
+	{
+	case naiveReduction: return "naive";
+	case neumaierReduction: return "neumaier";
+	case pairwiseReduction: return "pairwise";
+	default: return "deterministic";
+	}
+}
+
+// Parse "kind[,chunk]" where kind is static, dynamic, guided or auto; the
+// chunk counts chunkSamples-long chunks
+bool parseSchedule(const char* text, Schedule& schedule)
+{
+	const char* comma = strchr(text, ',');
+	const size_t length = comma ? static_cast<size_t>(comma - text) : strlen(text);
+	const string kind(text, length);
+
+	if (kind == "static") schedule.kind = omp_sched_static;
+	else if (kind == "dynamic") schedule.kind = omp_sched_dynamic;
+	else if (kind == "guided") schedule.kind = omp_sched_guided;
+	else if (kind == "auto") schedule.kind = omp_sched_auto;
+	else return false;
+
+	schedule.chunk = comma ? atoi(comma + 1) : 0;
+	return schedule.chunk >= 0;
+}
+
+const char* scheduleName(const Schedule& schedule)
+{
+	switch (schedule.kind)
+	{
+	case omp_sched_static: return "static";
+	case omp_sched_dynamic: return "dynamic";
+	case omp_sched_guided: return "guided";
+	default: return "auto";
+	}
+}
+
+// Samples per chunk: long enough that handing out a chunk costs next to
+// nothing against evaluating it, short enough that the naive sum inside a
+// chunk stays accurate and the last chunks balance the team
+const int chunkSamples = 1 << 15;
+
+// Chunk sums handed out by the runtime schedule and added into one
+// Accumulator per thread; the thread totals are then combined in thread
+// order, after the sum head of the done chunks already summed by the caller
+template <typename Accumulator>
+static double reduceChunks(const Integrand& f, const double x1, const double dx, long long first, long long last,
+                           long long done, long long chunks, double head, const int nThreads, ChunkSum sum)
+{
+	vector<Accumulator> partial(nThreads);
+
+	tracer.begin("chunks", nThreads);
+	#pragma omp parallel num_threads(nThreads) if(nThreads > 1)
+	{
+		Accumulator local;
+
+		#pragma omp for schedule(runtime) nowait
+		for (long long chunk = done; chunk < chunks; chunk++)
+		{
+			TracedIteration traced;
+			const long long begin = first + chunk * chunkSamples;
+			local.add(sum(f, x1, dx, begin, min<long long>(chunkSamples, last - begin)));
+		}
+		partial[omp_get_thread_num()] = local;
+	}
+	tracer.end();
+
+	Accumulator total;
+	if (done) total.add(head);
+	for (const Accumulator& thread : partial) total.merge(thread);
+	return total.total();
+}
+
+// Teams threadsFor weighs for a request of maxThreads: 2, 4, 8, ... and
+// maxThreads itself, never more threads than processors
+vector<int> CostModel::teamSizes(int maxThreads)
+{
+	maxThreads = max(1, min(maxThreads, omp_get_num_procs()));
+	vector<int> sizes;
+	for (int p = 2; p / 2 < maxThreads; p *= 2) sizes.push_back(min(p, maxThreads));
+	return sizes;
+}
+
+// Team size that finishes chunks chunks of chunkTime seconds soonest: one
+// chunk round per thread plus the fork/join cost, over teamSizes(maxThreads).
+// A team size that was never calibrated is never chosen.
+int CostModel::threadsFor(long long chunks, double chunkTime, int maxThreads) const
+{
+	int best = 1;
+	double bestTime = chunks * chunkTime;
+	for (int threads : teamSizes(maxThreads))
+	{
+		const auto known = forkJoin.find(threads);
+		if (known == forkJoin.end()) continue;
+		const double time = (chunks + threads - 1) / threads * chunkTime + known->second;
+		if (time < bestTime)
+		{
+			best = threads;
+			bestTime = time;
+		}
+	}
+	return best;
+}
+
+// Fork/join cost of every team size a request of maxThreads may use.
+// Calibration file lines: cpu model, team size, seconds per parallel region.
+// A miss (or every size with recalibrate) is measured as the best average of
+// 5 batches of 100 near-empty regions (after waking the team) and appended.
+void CostModel::calibrate(int maxThreads, const char* file, bool recalibrate)
+{
+	const string cpu = cpuModel();
+	if (!loaded && !recalibrate)
+	{
+		ifstream in(file);
+		string line;
+		while (getline(in, line))
+		{
+			istringstream fields(line);
+			string model;
+			int entryThreads;
+			double seconds;
+			if (!getline(fields, model, '\t') || !(fields >> entryThreads >> seconds)) continue;
+			if (model == cpu) forkJoin[entryThreads] = seconds;
+		}
+	}
+	loaded = true;
+
+	for (int threads : teamSizes(maxThreads))
+	{
+		if (forkJoin.count(threads)) continue;
+
+		// Every thread touches its own slot so the regions cannot be optimized away
+		vector<long long> visits(threads);
+		for (int i = 0; i < 10; i++)
+		{
+			#pragma omp parallel num_threads(threads)
+			visits[omp_get_thread_num()]++;
+		}
+		double best = numeric_limits<double>::infinity();
+		for (int batch = 0; batch < 5; batch++)
+		{
+			const double start = omp_get_wtime();
+			for (int i = 0; i < 100; i++)
+			{
+				#pragma omp parallel num_threads(threads)
+				visits[omp_get_thread_num()]++;
+			}
+			best = min(best, (omp_get_wtime() - start) / 100);
+		}
+		forkJoin[threads] = best;
+
+		ofstream out(file, ios::app);
+		out << cpu << '\t' << threads << '\t' << setprecision(6) << best << endl;
+	}
+}
+
+// Job mode: the enclosing team is already busy with other jobs, so the
+// range is halved on chunk boundaries into tasks for it rather than opening
+// a nested team. The fixed split makes the sum independent of the schedule.
+static double taskedSum(const Integrand& f, const double x1, const double dx, long long first, long long last,
+                        ChunkSum sum)
+{
+	const long long chunks = (last - first + chunkSamples - 1) / chunkSamples;
+	if (chunks <= 1) return sum(f, x1, dx, first, max(last - first, 0LL));
+
+	const long long middle = first + chunks / 2 * chunkSamples;
+	double lower, upper;
+	#pragma omp task shared(lower)
+	lower = taskedSum(f, x1, dx, first, middle, sum);
+	upper = taskedSum(f, x1, dx, middle, last, sum);
+	#pragma omp taskwait
+	return lower + upper;
+}
+
+// Sum of f(x1 + i * dx) for i in [first, last). The range is cut into
+// chunkSamples-long chunks, handed out by the --schedule choice; each chunk is
+// summed by the kernel in plain (vector) arithmetic, and the chunk sums are
+// combined as the reduction asks:
+//   naive          plain per-thread sums, like reduction(+: s)
+//   neumaier       compensated per-thread sums: error near that of one chunk
+//   pairwise       per-thread streaming pairwise sums: O(log chunks) error
+//                  without storing the chunk sums
+//   deterministic  every chunk sum stored by index and tree-summed in index
+//                  order: bit-identical for any thread count or schedule
+//                  (given the same SIMD kernel), at 8 bytes per chunk
+// Only deterministic fixes the order; the others depend on which thread ran
+// which chunk. Inside a parallel region (job mode) the chunks become tasks
+// instead and the reduction does not apply.
+//
+// With the cost model on, chunk 0 is summed on the calling thread first and
+// timed; the other chunks get the team size the model expects to finish them
+// soonest, down to no parallel region at all. Chunk 0 stays chunk 0, so
+// deterministic sums are unchanged.
+double chunkedSum(const Integrand& f, const double x1, const double dx, long long first, long long last,
+                  const int nThreads, ChunkSum sum, Reduction reduction)
+{
+	if (omp_get_level() > 0) return taskedSum(f, x1, dx, first, last, sum);
+
+	const long long chunks = (max(last - first, 0LL) + chunkSamples - 1) / chunkSamples;
+	long long done = 0;
+	double head = 0.0;
+	int team = nThreads;
+	if (costModel.enabled && nThreads > 1)
+	{
+		team = 1;
+		if (chunks > 1)
+		{
+			const double start = omp_get_wtime();
+			head = sum(f, x1, dx, first, chunkSamples);
+			done = 1;
+			team = costModel.threadsFor(chunks - 1, omp_get_wtime() - start, nThreads);
+		}
+	}
+	costModel.useTeam(team);
+
+	switch (reduction)
+	{
+	case naiveReduction: return reduceChunks<PlainSum>(f, x1, dx, first, last, done, chunks, head, team, sum);
+	case neumaierReduction:
+		return reduceChunks<CompensatedSum>(f, x1, dx, first, last, done, chunks, head, team, sum);
+	case pairwiseReduction: return reduceChunks<PairwiseSum>(f, x1, dx, first, last, done, chunks, head, team, sum);
+	default: break;
+	}
+
+	vector<double> chunkSums(chunks);
+	if (done) chunkSums[0] = head;
+
+	tracer.begin("chunks (deterministic)", team);
+	#pragma omp parallel for schedule(runtime) num_threads(team) if(team > 1)
+	for (long long chunk = done; chunk < chunks; chunk++)
+	{
+		TracedIteration traced;
+		const long long begin = first + chunk * chunkSamples;
+		chunkSums[chunk] = sum(f, x1, dx, begin, min<long long>(chunkSamples, last - begin));
+	}
+	tracer.end();
+	return pairwiseSum(chunkSums.data(), chunks);
 }
 
-double f(const double x)
+// sin(x) written for vectorization: no branches, table lookups or calls, so
+// the compiler can keep every step in SIMD registers. x is reduced by the
+// nearest multiple q of pi (Cody-Waite, pi split in four parts), and
+// sin(r) on [-pi/2, pi/2] is an odd degree-19 minimax polynomial (the
+// coefficients of SLEEF's sin_u35), negated for odd q. Accurate to a few ulp
+// for |x| < simdSinLimit.
+static FORCE_INLINE double simdSin(double x)
 {
-	return sin(x);
+	const double piA = 3.1415926218032836914, piB = 3.1786509424591713469e-08;
+	const double piC = 1.2246467864107188502e-16, piD = 1.2736634327021899816e-24;
+	const double roundMagic = 6755399441055744.0;  // 1.5 * 2^52: adding it rounds to an integer
+
+	const double q = (x * 0.318309886183790671538 + roundMagic) - roundMagic;
+	double r = x - q * piA;
+	r -= q * piB;
+	r -= q * piC;
+	r -= q * piD;
+
+	const double r2 = r * r;
+	double u = -7.97255955009037868891952e-18;
+	u = u * r2 + 2.81009972710863200091251e-15;
+	u = u * r2 - 7.64712219118158833288484e-13;
+	u = u * r2 + 1.60590430605664501629054e-10;
+	u = u * r2 - 2.50521083763502045810755e-08;
+	u = u * r2 + 2.75573192239198747630416e-06;
+	u = u * r2 - 0.000198412698412696162806809;
+	u = u * r2 + 0.00833333333333332974823815;
+	u = u * r2 - 0.166666666666666657414808;
+	const double y = r2 * (u * r) + r;
+
+	return (static_cast<int>(q) & 1) ? -y : y;
+}
+
+// 2^k for -1022 <= k <= 1023: k + 1023 lands in the low mantissa bits of
+// k + 1023 + 2^52 and is shifted up into the exponent field, which avoids an
+// integer-to-int64 conversion the vectorizer does not support
+static FORCE_INLINE double simdPow2(int k)
+{
+	const double biased = k + (1023.0 + 4503599627370496.0);
+	uint64_t bits;
+	memcpy(&bits, &biased, sizeof bits);
+	bits <<= 52;
+	double value;
+	memcpy(&value, &bits, sizeof value);
+	return value;
+}
+
+// exp(x) in the same style: x = q ln2 + r with ln2 split in two parts, a
+// degree-11 polynomial on |r| <= ln2 / 2 (SLEEF's exp coefficients), and 2^q
+// applied in two halves so results near the under- and overflow limits stay
+// exact. q is clamped as an integer, which yields 0 and inf past the double
+// range; a floating-point clamp would stay a branch under -ftrapping-math
+// and stop the loop from vectorizing. Accurate for |x| < simdSinLimit.
+static FORCE_INLINE double simdExp(double x)
+{
+	const double ln2Hi = 0.69314718055966295651160180568695068359375;
+	const double ln2Lo = 0.28235290563031577122588448175013436025525412068e-12;
+	const double roundMagic = 6755399441055744.0;
+
+	const double q = (x * 1.442695040888963407359924681001892137 + roundMagic) - roundMagic;
+	double r = x - q * ln2Hi;
+	r -= q * ln2Lo;
+
+	double u = 2.08860621107283687536341e-09;
+	u = u * r + 2.51112930892876518610661e-08;
+	u = u * r + 2.75573911234900471893338e-07;
+	u = u * r + 2.75572362911928827629423e-06;
+	u = u * r + 2.4801587159235472998791e-05;
+	u = u * r + 0.000198412698960509205564975;
+	u = u * r + 0.00138888888889774492207962;
+	u = u * r + 0.00833333333331652721664984;
+	u = u * r + 0.0416666666666665047591422;
+	u = u * r + 0.166666666666666851703837;
+	u = u * r + 0.5;
+	u = r * r * u + r + 1.0;
+
+	int k = static_cast<int>(q);
+	k = k < -2044 ? -2044 : k;
+	k = k > 2046 ? 2046 : k;
+	const int half = k >> 1;
+	return u * simdPow2(half) * simdPow2(k - half);
+}
+
+// Functors behind the registry: scalar() is the libm reference used by
+// methods 1-4, simd() the branch-free form the vector kernels inline
+struct SinFunctor
+{
+	static double scalar(const Integrand&, double x) { return sin(x); }
+	static FORCE_INLINE double simd(const Integrand&, double x) { return simdSin(x); }
+};
+
+struct ExpFunctor
+{
+	static double scalar(const Integrand&, double x) { return exp(x); }
+	static FORCE_INLINE double simd(const Integrand&, double x) { return simdExp(x); }
+};
+
+struct GaussianFunctor
+{
+	static double scalar(const Integrand&, double x) { return exp(-x * x); }
+	static FORCE_INLINE double simd(const Integrand&, double x) { return simdExp(-x * x); }
+};
+
+// Horner's rule over the coefficients, highest degree first; the vector
+// kernels run it per block in sumSimd<PolynomialFunctor>, because the degree
+// is only known at run time
+struct PolynomialFunctor
+{
+	static double scalar(const Integrand& f, double x)
+	{
+		const double* c = f.coefficients.data();
+		double y = 0.0;
+		for (int k = static_cast<int>(f.coefficients.size()) - 1; k >= 0; k--) y = y * x + c[k];
+		return y;
+	}
+};
+
+// Interprets the compiled program one sample at a time; the vector kernels
+// use the block interpreter in sumSimd<ExpressionFunctor> instead. evaluate
+// takes every coordinate, for the Monte Carlo methods.
+struct ExpressionFunctor
+{
+	static double scalar(const Integrand& f, double x) { return evaluate(f.expression, &x); }
+
+	static double evaluate(const Expression& expression, const double* x)
+	{
+		double stack[Expression::maxDepth];
+		int top = -1;
+		for (const Expression::Instruction& op : expression.program)
+		{
+			switch (op.code)
+			{
+			case Expression::variable: stack[++top] = x[static_cast<int>(op.value)]; break;
+			case Expression::constant: stack[++top] = op.value; break;
+			case Expression::add: top--; stack[top] += stack[top + 1]; break;
+			case Expression::subtract: top--; stack[top] -= stack[top + 1]; break;
+			case Expression::multiply: top--; stack[top] *= stack[top + 1]; break;
+			case Expression::divide: top--; stack[top] /= stack[top + 1]; break;
+			case Expression::power: top--; stack[top] = pow(stack[top], stack[top + 1]); break;
+			case Expression::integerPower: stack[top] = pow(stack[top], op.value); break;
+			case Expression::negate: stack[top] = -stack[top]; break;
+			case Expression::sine: stack[top] = sin(stack[top]); break;
+			case Expression::cosine: stack[top] = cos(stack[top]); break;
+			case Expression::exponential: stack[top] = exp(stack[top]); break;
+			case Expression::logarithm: stack[top] = log(stack[top]); break;
+			case Expression::squareRoot: stack[top] = sqrt(stack[top]); break;
+			case Expression::absolute: stack[top] = abs(stack[top]); break;
+			}
+		}
+		return stack[0];
+	}
+};
+
+template <typename F>
+double sumScalar(const Integrand& f, double x1, double dx, long long first, long long count)
+{
+	double s = 0;
+	for (long long i = first; i < first + count; i++) s += F::scalar(f, x1 + i * dx);
+	return s;
+}
+
+// One loop body for every instruction set and functor; the simd reduction
+// gives each lane its own partial sum, combined once at the end. count is at
+// most one chunk.
+template <typename F>
+static FORCE_INLINE double sumSimd(const Integrand& f, double x1, double dx, long long first, long long count)
+{
+	// base + j is exact, so x matches x1 + i * dx while the induction stays 32-bit
+	const double base = static_cast<double>(first);
+	const int n = static_cast<int>(count);
+	double s = 0;
+	#pragma omp simd reduction(+: s)
+	for (int j = 0; j < n; j++) s += F::simd(f, x1 + (base + j) * dx);
+	return s;
+}
+
+// Samples per block of the block-wise vector kernels: the working arrays stay
+// in L1 while each loop is long enough to vectorize
+const int simdBlock = 256;
+
+// Polynomials run one Horner step at a time over a block of samples, so
+// every step is a vector multiply-add whatever the degree
+template <>
+FORCE_INLINE double sumSimd<PolynomialFunctor>(const Integrand& f, double x1, double dx, long long first,
+                                               long long count)
+{
+	const double* c = f.coefficients.data();
+	const int degree = static_cast<int>(f.coefficients.size()) - 1;
+	double x[simdBlock], y[simdBlock];
+	double s = 0;
+
+	for (long long start = 0; start < count; start += simdBlock)
+	{
+		const double base = static_cast<double>(first + start);
+		const int n = static_cast<int>(min<long long>(simdBlock, count - start));
+
+		#pragma omp simd
+		for (int j = 0; j < n; j++)
+		{
+			x[j] = x1 + (base + j) * dx;
+			y[j] = c[degree];
+		}
+		for (int k = degree - 1; k >= 0; k--)
+		{
+			#pragma omp simd
+			for (int j = 0; j < n; j++) y[j] = y[j] * x[j] + c[k];
+		}
+
+		#pragma omp simd reduction(+: s)
+		for (int j = 0; j < n; j++) s += y[j];
+	}
+	return s;
+}
+
+// Expressions run instruction by instruction over blocks of samples: each
+// opcode is a vector loop over the block, and sin/exp use the inlined vector
+// forms (cos and log stay libm calls)
+template <>
+FORCE_INLINE double sumSimd<ExpressionFunctor>(const Integrand& f, double x1, double dx, long long first,
+                                               long long count)
+{
+	const int block = simdBlock;
+	double stack[Expression::maxDepth][block];
+	double s = 0;
+
+	for (long long start = 0; start < count; start += block)
+	{
+		const double base = static_cast<double>(first + start);
+		const int n = static_cast<int>(min<long long>(block, count - start));
+		int top = -1;
+
+		for (const Expression::Instruction& op : f.expression.program)
+		{
+			double* push = stack[min(top + 1, Expression::maxDepth - 1)];
+			double* lhs = stack[max(top - 1, 0)];
+			double* a = stack[max(top, 0)];  // operand of a function, right operand of a binary operator
+			switch (op.code)
+			{
+			case Expression::variable:
+				#pragma omp simd
+				for (int j = 0; j < n; j++) push[j] = x1 + (base + j) * dx;
+				top++;
+				break;
+			case Expression::constant:
+				for (int j = 0; j < n; j++) push[j] = op.value;
+				top++;
+				break;
+			case Expression::add:
+				#pragma omp simd
+				for (int j = 0; j < n; j++) lhs[j] += a[j];
+				top--;
+				break;
+			case Expression::subtract:
+				#pragma omp simd
+				for (int j = 0; j < n; j++) lhs[j] -= a[j];
+				top--;
+				break;
+			case Expression::multiply:
+				#pragma omp simd
+				for (int j = 0; j < n; j++) lhs[j] *= a[j];
+				top--;
+				break;
+			case Expression::divide:
+				#pragma omp simd
+				for (int j = 0; j < n; j++) lhs[j] /= a[j];
+				top--;
+				break;
+			case Expression::power:
+				for (int j = 0; j < n; j++) lhs[j] = pow(lhs[j], a[j]);
+				top--;
+				break;
+			case Expression::integerPower:
+			{
+				// Square-and-multiply with the exponent fixed at compile time
+				double result[block];
+				for (int j = 0; j < n; j++) result[j] = 1.0;
+				for (long long e = static_cast<long long>(abs(op.value)); e; e >>= 1)
+				{
+					if (e & 1)
+					{
+						#pragma omp simd
+						for (int j = 0; j < n; j++) result[j] *= a[j];
+					}
+					#pragma omp simd
+					for (int j = 0; j < n; j++) a[j] *= a[j];
+				}
+				const bool reciprocal = op.value < 0;
+				#pragma omp simd
+				for (int j = 0; j < n; j++) a[j] = reciprocal ? 1.0 / result[j] : result[j];
+				break;
+			}
+			case Expression::negate:
+				#pragma omp simd
+				for (int j = 0; j < n; j++) a[j] = -a[j];
+				break;
+			case Expression::sine:
+				#pragma omp simd
+				for (int j = 0; j < n; j++) a[j] = simdSin(a[j]);
+				break;
+			case Expression::cosine:
+				for (int j = 0; j < n; j++) a[j] = cos(a[j]);
+				break;
+			case Expression::exponential:
+				#pragma omp simd
+				for (int j = 0; j < n; j++) a[j] = simdExp(a[j]);
+				break;
+			case Expression::logarithm:
+				for (int j = 0; j < n; j++) a[j] = log(a[j]);
+				break;
+			case Expression::squareRoot:
+				#pragma omp simd
+				for (int j = 0; j < n; j++) a[j] = sqrt(a[j]);
+				break;
+			case Expression::absolute:
+				#pragma omp simd
+				for (int j = 0; j < n; j++) a[j] = abs(a[j]);
+				break;
+			}
+		}
+
+		const double* y = stack[0];
+		#pragma omp simd reduction(+: s)
+		for (int j = 0; j < n; j++) s += y[j];
+	}
+	return s;
+}
+
+template <typename F>
+static double sumGeneric(const Integrand& f, double x1, double dx, long long first, long long count)
+{
+	return sumSimd<F>(f, x1, dx, first, count);
+}
+
+#ifdef HAVE_X86_SIMD_KERNELS
+template <typename F>
+__attribute__((target("avx2,fma")))
+static double sumAvx2(const Integrand& f, double x1, double dx, long long first, long long count)
+{
+	return sumSimd<F>(f, x1, dx, first, count);
+}
+
+template <typename F>
+__attribute__((target("avx512f")))
+static double sumAvx512(const Integrand& f, double x1, double dx, long long first, long long count)
+{
+	return sumSimd<F>(f, x1, dx, first, count);
+}
+#endif
+
+// Registry entry for functor F: every kernel is an instantiation for F, so
+// the integrand is inlined into each sample loop
+template <typename F>
+static Integrand makeIntegrand(const string& name, double simdLimit)
+{
+	Integrand f;
+	f.name = name;
+	f.simdLimit = simdLimit;
+	f.value = F::scalar;
+	f.scalar = sumScalar<F>;
+	f.simd[0] = sumGeneric<F>;
+#ifdef HAVE_X86_SIMD_KERNELS
+	f.simd[1] = sumAvx2<F>;
+	f.simd[2] = sumAvx512<F>;
+#else
+	f.simd[1] = f.simd[2] = sumGeneric<F>;
+#endif
+	return f;
+}
+
+// Recursive-descent compiler for user expressions:
+//   expression := term (('+' | '-') term)*
+//   term       := unary (('*' | '/') unary)*
+//   unary      := '-' unary | power
+//   power      := primary ('^' unary)?
+//   primary    := number | x | x1 ... x6 | pi | e | function '(' expression ')' | '(' expression ')'
+// with functions sin, cos, exp, log, sqrt and abs. Throws invalid_argument.
+class ExpressionCompiler
+{
+public:
+	ExpressionCompiler(const char* text, Expression& expression) : text(text), position(text), out(expression) {}
+
+	void compile()
+	{
+		out.program.clear();
+		out.dimensions = 1;
+		depth = maxDepth = 0;
+		parseExpression();
+		skipSpaces();
+		if (*position) fail("unexpected character");
+	}
+
+private:
+	const char* text;
+	const char* position;
+	Expression& out;
+	int depth, maxDepth;
+
+	void fail(const char* message)
+	{
+		throw invalid_argument(string("Expression error at column ") + to_string(position - text + 1) + ": " +
+		                       message);
+	}
+
+	void skipSpaces()
+	{
+		while (isspace(static_cast<unsigned char>(*position))) position++;
+	}
+
+	bool accept(char c)
+	{
+		skipSpaces();
+		if (*position != c) return false;
+		position++;
+		return true;
+	}
+
+	// Stack effect of each opcode: pushes +1, binary operators -1, functions 0
+	void emit(Expression::Code code, double value = 0.0)
+	{
+		if (code == Expression::variable || code == Expression::constant) depth++;
+		else if (code >= Expression::add && code <= Expression::power) depth--;
+		maxDepth = max(maxDepth, depth);
+		if (maxDepth > Expression::maxDepth) fail("nested too deeply");
+		out.program.push_back({ code, value });
+	}
+
+	void parseExpression()
+	{
+		parseTerm();
+		while (true)
+		{
+			if (accept('+')) { parseTerm(); emit(Expression::add); }
+			else if (accept('-')) { parseTerm(); emit(Expression::subtract); }
+			else return;
+		}
+	}
+
+	void parseTerm()
+	{
+		parseUnary();
+		while (true)
+		{
+			if (accept('*')) { parseUnary(); emit(Expression::multiply); }
+			else if (accept('/')) { parseUnary(); emit(Expression::divide); }
+			else return;
+		}
+	}
+
+	void parseUnary()
+	{
+		if (accept('-'))
+		{
+			parseUnary();
+			emit(Expression::negate);
+		}
+		else parsePower();
+	}
+
+	void parsePower()
+	{
+		parsePrimary();
+		if (!accept('^')) return;
+		parseUnary();
+
+		// A constant integer exponent becomes repeated multiplication
+		Expression::Instruction& last = out.program.back();
+		if (last.code == Expression::constant && last.value == floor(last.value) && abs(last.value) <= 64)
+		{
+			const double exponent = last.value;
+			out.program.pop_back();
+			depth--;
+			emit(Expression::integerPower, exponent);
+		}
+		else emit(Expression::power);
+	}
+
+	void parsePrimary()
+	{
+		skipSpaces();
+		if (accept('('))
+		{
+			parseExpression();
+			if (!accept(')')) fail("expected ')'");
+			return;
+		}
+		if (isdigit(static_cast<unsigned char>(*position)) || *position == '.')
+		{
+			char* end;
+			const double value = strtod(position, &end);
+			position = end;
+			emit(Expression::constant, value);
+			return;
+		}
+
+		const char* start = position;
+		while (isalpha(static_cast<unsigned char>(*position))) position++;
+		const string name(start, position);
+		if (name.empty()) fail("expected a number, x, a constant or a function");
+		if (name == "x")
+		{
+			// x1 to x6 name the coordinates of the Monte Carlo methods; x is x1
+			if (*position < '1' || *position > '0' + maxDimensions) return emit(Expression::variable, 0);
+			const int coordinate = *position++ - '1';
+			out.dimensions = max(out.dimensions, coordinate + 1);
+			return emit(Expression::variable, coordinate);
+		}
+		if (name == "pi") return emit(Expression::constant, 3.14159265358979323846);
+		if (name == "e") return emit(Expression::constant, 2.71828182845904523536);
+
+		static const struct { const char* name; Expression::Code code; } functions[] = {
+			{ "sin", Expression::sine }, { "cos", Expression::cosine }, { "exp", Expression::exponential },
+			{ "log", Expression::logarithm }, { "sqrt", Expression::squareRoot }, { "abs", Expression::absolute }
+		};
+		for (const auto& function : functions)
+		{
+			if (name != function.name) continue;
+			if (!accept('(')) fail("expected '(' after function name");
+			parseExpression();
+			if (!accept(')')) fail("expected ')'");
+			return emit(function.code);
+		}
+		position = start;
+		fail("unknown name");
+	}
+};
+
+// Look up an integrand by name: sin, exp, gaussian (exp(-x^2)),
+// polynomial[:c0,c1,...] (constant term first, default x^2) or expr:<expression in x>
+bool parseIntegrand(const char* text, Integrand& f)
+{
+	const double unlimited = numeric_limits<double>::infinity();
+	const double vectorLimit = simdSinLimit;  // simdSin and simdExp
+
+	if (strcmp(text, "sin") == 0) f = makeIntegrand<SinFunctor>("sin", vectorLimit);
+	else if (strcmp(text, "exp") == 0) f = makeIntegrand<ExpFunctor>("exp", vectorLimit);
+	else if (strcmp(text, "gaussian") == 0) f = makeIntegrand<GaussianFunctor>("gaussian", sqrt(vectorLimit));
+	else if (strncmp(text, "polynomial", 10) == 0 && (text[10] == '\0' || text[10] == ':'))
+	{
+		f = makeIntegrand<PolynomialFunctor>("polynomial", unlimited);
+		f.coefficients.clear();
+		if (text[10] == '\0') f.coefficients = { 0.0, 0.0, 1.0 };
+		for (const char* next = text + 10; *next == ':' || *next == ','; )
+		{
+			char* end;
+			f.coefficients.push_back(strtod(next + 1, &end));
+			if (end == next + 1) return false;
+			next = end;
+			if (*next != ',' && *next != '\0') return false;
+		}
+	}
+	else if (strncmp(text, "expr:", 5) == 0)
+	{
+		f = makeIntegrand<ExpressionFunctor>("expr", vectorLimit);
+		try
+		{
+			ExpressionCompiler(text + 5, f.expression).compile();
+		}
+		catch (invalid_argument& e)
+		{
+			cerr << e.what() << endl;
+			return false;
+		}
+	}
+	else return false;
+	return true;
+}
+
+// "host", "gpu" (the default device) or a device number
+bool parseDevice(const char* text, int& device)
+{
+	if (strcmp(text, "host") == 0) device = -1;
+	else if (strcmp(text, "gpu") == 0) device = omp_get_default_device();
+	else
+	{
+		char* end;
+		device = static_cast<int>(strtol(text, &end, 10));
+		return end != text && *end == '\0' && device >= 0;
+	}
+	return true;
+}
+
+string deviceName(int device)
+{
+	return device < 0 ? "host" : "device" + to_string(device);
+}
+
+// Pick the vector instruction set by name, or the widest one this CPU supports for "auto"
+const SimdKernel& selectSimdKernel(const char* name)
+{
+	static const SimdKernel generic = { "generic", 2, 0 };
+#ifdef HAVE_X86_SIMD_KERNELS
+	static const SimdKernel avx2 = { "avx2", 4, 1 };
+	static const SimdKernel avx512 = { "avx512", 8, 2 };
+	const bool hasAvx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	const bool hasAvx512 = __builtin_cpu_supports("avx512f");
+
+	if (strcmp(name, "auto") == 0) return hasAvx512 ? avx512 : hasAvx2 ? avx2 : generic;
+	if (strcmp(name, "avx512") == 0 && hasAvx512) return avx512;
+	if (strcmp(name, "avx2") == 0 && hasAvx2) return avx2;
+#else
+	if (strcmp(name, "auto") == 0) return generic;
+#endif
+	if (strcmp(name, "generic") == 0) return generic;
+	throw invalid_argument(string("SIMD kernel not available: ") + name);
+}
+
+const Result simdRectangleMethod(const double x1, const double x2, const double dx, const int nThreads,
+                                 const Integrand& f, const SimdKernel& kernel, Reduction reduction)
+{
+	const long long N = sampleCount(x1, x2, dx);
+	double now = omp_get_wtime();
+
+	const double s = chunkedSum(f, x1, dx, 1, N + 1, nThreads, f.simd[kernel.level], reduction) * dx;
+
+	return { omp_get_wtime() - now, s, N, 0.0, 0 };
+}
+
+const Result simdTrapezoidalMethod(const double x1, const double x2, const double dx, const int nThreads,
+                                   const Integrand& f, const SimdKernel& kernel, Reduction reduction)
+{
+	const long long N = sampleCount(x1, x2, dx);
+	double now = omp_get_wtime();
+
+	// The end points go through the same vector kernel as one-sample chunks
+	const ChunkSum sum = f.simd[kernel.level];
+	double s = chunkedSum(f, x1, dx, 1, N, nThreads, sum, reduction);
+	s = (s + (sum(f, x1, 0.0, 0, 1) + sum(f, x2, 0.0, 0, 1)) / 2) * dx;
+
+	return { omp_get_wtime() - now, s, max(N - 1, 0LL) + 2, 0.0, 0 };
+}
+
+// Settings shared by every subinterval of an adaptive run
+struct AdaptiveSetup
+{
+	const Integrand& f;
+	int taskDepth;  // subintervals above this depth are refined as tasks
+	int maxDepth;   // subintervals at this depth are accepted unconverged
+};
+
+static AdaptiveResult combine(const AdaptiveResult& left, const AdaptiveResult& right)
+{
+	return { left.area + right.area, left.error + right.error, left.evaluations + right.evaluations,
+	         left.unconverged + right.unconverged };
+}
+
+// Recursive adaptive Simpson on [a, b] with the end point and midpoint values
+// fa, fm, fb and the one-panel estimate whole already known. Halves are
+// accepted once they agree with whole to 15 * tolerance (the Richardson
+// bound for Simpson's rule), and the extrapolated sum is returned; otherwise
+// each half is refined with half the tolerance, the left one as a task while
+// depth < taskDepth.
+static AdaptiveResult adaptiveSimpson(const AdaptiveSetup& setup, double a, double b, double fa, double fm,
+                                      double fb, double whole, double tolerance, int depth)
+{
+	const Integrand& f = setup.f;
+	const double m = (a + b) / 2, lm = (a + m) / 2, rm = (m + b) / 2;
+	const double flm = f.value(f, lm), frm = f.value(f, rm);
+	const double left = (m - a) / 6 * (fa + 4 * flm + fm);
+	const double right = (b - m) / 6 * (fm + 4 * frm + fb);
+	const double delta = left + right - whole;
+
+	// Also stop once the midpoints no longer separate in floating point
+	const bool converged = abs(delta) <= 15 * tolerance;
+	if (converged || depth >= setup.maxDepth || lm <= a || rm >= b)
+		return { left + right + delta / 15, abs(delta) / 15, 2, converged ? 0 : 1 };
+
+	AdaptiveResult lower, upper;
+	if (depth < setup.taskDepth)
+	{
+		#pragma omp task shared(lower)
+		lower = adaptiveSimpson(setup, a, m, fa, flm, fm, left, tolerance / 2, depth + 1);
+		upper = adaptiveSimpson(setup, m, b, fm, frm, fb, right, tolerance / 2, depth + 1);
+		#pragma omp taskwait
+	}
+	else
+	{
+		lower = adaptiveSimpson(setup, a, m, fa, flm, fm, left, tolerance / 2, depth + 1);
+		upper = adaptiveSimpson(setup, m, b, fm, frm, fb, right, tolerance / 2, depth + 1);
+	}
+	AdaptiveResult result = combine(lower, upper);
+	result.evaluations += 2;
+	return result;
+}
+
+// 15-point Kronrod rule with its embedded 7-point Gauss rule (QUADPACK's
+// qk15 nodes and weights), node k at +-kronrodNodes[k], k = 7 the centre
+static const double kronrodNodes[8] = {
+	0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+	0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+	0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+	0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+};
+static const double kronrodWeights[8] = {
+	0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+	0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+	0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+	0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+// Gauss weights of the odd Kronrod nodes 1, 3, 5 and the centre
+static const double gaussWeights[4] = {
+	0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+	0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+
+// Recursive Gauss-Kronrod on [a, b]: the G7/K15 difference estimates the
+// error of the K15 result, which is accepted below tolerance; otherwise each
+// half is refined with half the tolerance, as tasks like adaptiveSimpson.
+static AdaptiveResult adaptiveKronrod(const AdaptiveSetup& setup, double a, double b, double tolerance, int depth)
+{
+	const Integrand& f = setup.f;
+	const double centre = (a + b) / 2, halfLength = (b - a) / 2;
+	const double fc = f.value(f, centre);
+	double kronrod = kronrodWeights[7] * fc, gauss = gaussWeights[3] * fc;
+	for (int k = 0; k < 7; k++)
+	{
+		const double offset = halfLength * kronrodNodes[k];
+		const double pair = f.value(f, centre - offset) + f.value(f, centre + offset);
+		kronrod += kronrodWeights[k] * pair;
+		if (k % 2 == 1) gauss += gaussWeights[k / 2] * pair;
+	}
+	kronrod *= halfLength;
+	gauss *= halfLength;
+	const double error = abs(kronrod - gauss);
+
+	const bool converged = error <= tolerance;
+	if (converged || depth >= setup.maxDepth || centre <= a || centre >= b)
+		return { kronrod, error, 15, converged ? 0 : 1 };
+
+	AdaptiveResult lower, upper;
+	if (depth < setup.taskDepth)
+	{
+		#pragma omp task shared(lower)
+		lower = adaptiveKronrod(setup, a, centre, tolerance / 2, depth + 1);
+		upper = adaptiveKronrod(setup, centre, b, tolerance / 2, depth + 1);
+		#pragma omp taskwait
+	}
+	else
+	{
+		lower = adaptiveKronrod(setup, a, centre, tolerance / 2, depth + 1);
+		upper = adaptiveKronrod(setup, centre, b, tolerance / 2, depth + 1);
+	}
+	AdaptiveResult result = combine(lower, upper);
+	result.evaluations += 15;
+	return result;
+}
+
+// Tasks are only spawned down to taskDepth so their number stays bounded;
+// 0 picks enough levels to give every thread several subtrees to steal,
+// since adaptive trees are unbalanced.
+static int adaptiveTaskDepth(int taskDepth, int nThreads)
+{
+	if (taskDepth > 0) return taskDepth;
+	int depth = 4;
+	while ((1 << (depth - 4)) < nThreads) depth++;
+	return depth;
+}
+
+const Result adaptiveSimpsonMethod(const double x1, const double x2, const double tolerance, const int nThreads,
+                                   const Integrand& f, int taskDepth, int maxDepth)
+{
+	double now = omp_get_wtime();
+	const AdaptiveSetup setup = { f, adaptiveTaskDepth(taskDepth, nThreads), maxDepth };
+	AdaptiveResult result;
+
+	const auto refine = [&]()
+	{
+		const double fa = f.value(f, x1), fm = f.value(f, (x1 + x2) / 2), fb = f.value(f, x2);
+		const double whole = (x2 - x1) / 6 * (fa + 4 * fm + fb);
+		result = adaptiveSimpson(setup, x1, x2, fa, fm, fb, whole, tolerance, 0);
+		result.evaluations += 3;
+	};
+
+	// In job mode the tasks go to the team that runs the jobs
+	if (omp_get_level() > 0) refine();
+	else
+	{
+		costModel.useTeam(nThreads);
+		#pragma omp parallel num_threads(nThreads)
+		#pragma omp single
+		refine();
+	}
+
+	return { omp_get_wtime() - now, result.area, result.evaluations, result.error, result.unconverged };
+}
+
+const Result adaptiveKronrodMethod(const double x1, const double x2, const double tolerance, const int nThreads,
+                                   const Integrand& f, int taskDepth, int maxDepth)
+{
+	double now = omp_get_wtime();
+	const AdaptiveSetup setup = { f, adaptiveTaskDepth(taskDepth, nThreads), maxDepth };
+	AdaptiveResult result;
+
+	// In job mode the tasks go to the team that runs the jobs
+	if (omp_get_level() > 0) result = adaptiveKronrod(setup, x1, x2, tolerance, 0);
+	else
+	{
+		costModel.useTeam(nThreads);
+		#pragma omp parallel num_threads(nThreads)
+		#pragma omp single
+		result = adaptiveKronrod(setup, x1, x2, tolerance, 0);
+	}
+
+	return { omp_get_wtime() - now, result.area, result.evaluations, result.error, result.unconverged };
+}
+
+// Composite Simpson on an even number of steps of about dx (sampleCount rounds
+// down, so h may be a little wider), scaled to end exactly at x2: h/3 (f0 + 4 f1 + 2 f2 + ... + 4 f(N-1) + fN). The odd and the
+// interior even samples are two strided passes through the chunked driver.
+const Result simpsonMethod(const double x1, const double x2, const double dx, const int nThreads,
+                           const Integrand& f, ChunkSum sum, Reduction reduction)
+{
+	long long N = max(sampleCount(x1, x2, dx), 1LL);
+	N += N % 2;
+	const double h = (x2 - x1) / N;
+	double now = omp_get_wtime();
+
+	const double odd = chunkedSum(f, x1 + h, 2 * h, 0, N / 2, nThreads, sum, reduction);
+	const double even = chunkedSum(f, x1, 2 * h, 1, N / 2, nThreads, sum, reduction);
+	const double ends = sum(f, x1, 0.0, 0, 1) + sum(f, x2, 0.0, 0, 1);
+	const double s = (ends + 4 * odd + 2 * even) * h / 3;
+
+	return { omp_get_wtime() - now, s, N + 1, 0.0, 0 };
+}
+
+// Nodes are the roots of the Legendre polynomial P_n, found by Newton's
+// method from the Chebyshev-like guesses cos(pi (i + 3/4) / (n + 1/2))
+const GaussRule gaussLegendreRule(int points)
+{
+	GaussRule rule;
+	rule.nodes.resize(points);
+	rule.weights.resize(points);
+	for (int i = 0; i < (points + 1) / 2; i++)
+	{
+		double z = cos(M_PI * (i + 0.75) / (points + 0.5)), derivative = 1.0;
+		for (int iteration = 0; iteration < 100; iteration++)
+		{
+			double p = 1.0, previous = 0.0;
+			for (int j = 1; j <= points; j++)
+			{
+				const double next = ((2 * j - 1) * z * p - (j - 1) * previous) / j;
+				previous = p;
+				p = next;
+			}
+			derivative = points * (z * p - previous) / (z * z - 1);
+			const double step = p / derivative;
+			z -= step;
+			if (abs(step) <= 1e-16) break;
+		}
+		rule.nodes[i] = -z;
+		rule.nodes[points - 1 - i] = z;
+		rule.weights[i] = rule.weights[points - 1 - i] = 2 / ((1 - z * z) * derivative * derivative);
+	}
+	return rule;
+}
+
+// Composite Gauss-Legendre on panels of width about dx (sampleCount rounds
+// down, so h may be a little wider), scaled to end exactly at x2. Node j sits
+// at the same offset in every panel, so its samples form one h-strided pass
+// through the chunked driver.
+const Result gaussLegendreMethod(const double x1, const double x2, const double dx, const int nThreads,
+                                 const Integrand& f, ChunkSum sum, Reduction reduction, const GaussRule& rule)
+{
+	const long long N = max(sampleCount(x1, x2, dx), 1LL);
+	const double h = (x2 - x1) / N;
+	double now = omp_get_wtime();
+
+	double s = 0.0;
+	for (size_t j = 0; j < rule.nodes.size(); j++)
+		s += rule.weights[j] * chunkedSum(f, x1 + h / 2 * (1 + rule.nodes[j]), h, 0, N, nThreads, sum, reduction);
+	s *= h / 2;
+
+	return { omp_get_wtime() - now, s, N * static_cast<long long>(rule.nodes.size()), 0.0, 0 };
+}
+
+// Randomly shifted copies of the quasi-random sequence; the spread of their
+// means is the standard error, which a deterministic sequence cannot give
+const int qmcReplicates = 8;
+
+// Points per chunk of a Monte Carlo round
+const int monteCarloChunk = 4096;
+
+static inline uint64_t mix64(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// Point n of replicate r in [0, 1)^dimensions, a pure function of (seed, r, n):
+// threads produce their own points with no shared generator state
+struct PointSet
+{
+	Sampling sampling;
+	int dimensions;
+	uint64_t stream;
+	uint32_t direction[maxDimensions][32];            // Sobol direction numbers
+	uint32_t shift[qmcReplicates][maxDimensions];     // Sobol digital shifts
+	double offset[qmcReplicates][maxDimensions];      // Halton Cranley-Patterson shifts
+
+	PointSet(Sampling sampling, int dimensions, uint64_t seed);
+	void point(long long n, int replicate, double* u) const;
+};
+
+// Primitive polynomials and initial direction numbers of Sobol dimensions
+// 2-6 (Joe and Kuo); dimension 1 is the van der Corput sequence
+static const struct { int degree, coefficients; uint32_t initial[4]; } sobolPolynomials[maxDimensions - 1] = {
+	{ 1, 0, { 1 } }, { 2, 1, { 1, 3 } }, { 3, 1, { 1, 3, 1 } }, { 3, 2, { 1, 1, 1 } }, { 4, 1, { 1, 1, 3, 3 } }
+};
+
+PointSet::PointSet(Sampling sampling, int dimensions, uint64_t seed)
+	: sampling(sampling), dimensions(dimensions), stream(mix64(seed))
+{
+	for (int j = 0; j < 32; j++) direction[0][j] = 1u << (31 - j);
+	for (int k = 1; k < maxDimensions; k++)
+	{
+		const int s = sobolPolynomials[k - 1].degree, a = sobolPolynomials[k - 1].coefficients;
+		uint32_t* v = direction[k];
+		for (int j = 0; j < 32; j++)
+		{
+			if (j < s)
+			{
+				v[j] = sobolPolynomials[k - 1].initial[j] << (31 - j);
+				continue;
+			}
+			v[j] = v[j - s] ^ (v[j - s] >> s);
+			for (int l = 1; l < s; l++)
+				if ((a >> (s - 1 - l)) & 1) v[j] ^= v[j - l];
+		}
+	}
+
+	for (int r = 0; r < qmcReplicates; r++)
+	{
+		for (int k = 0; k < maxDimensions; k++)
+		{
+			const uint64_t bits = mix64(stream ^ mix64(static_cast<uint64_t>(r * maxDimensions + k) + 1));
+			shift[r][k] = static_cast<uint32_t>(bits >> 32);
+			offset[r][k] = static_cast<double>(bits >> 11) / 9007199254740992.0;
+		}
+	}
+}
+
+void PointSet::point(long long n, int replicate, double* u) const
+{
+	static const int primes[maxDimensions] = { 2, 3, 5, 7, 11, 13 };
+
+	switch (sampling)
+	{
+	case pseudoRandomSampling:
+	{
+		// 53 random bits per coordinate, counted over (replicate, n, k)
+		const uint64_t base = stream + (static_cast<uint64_t>(n) * qmcReplicates + replicate) * dimensions;
+		for (int k = 0; k < dimensions; k++) u[k] = static_cast<double>(mix64(base + k) >> 11) / 9007199254740992.0;
+		break;
+	}
+	case sobolSampling:
+		// Direct (not Gray-code) order: any n without its predecessors; the
+		// half step keeps shifted points off the cube's faces
+		for (int k = 0; k < dimensions; k++)
+		{
+			uint32_t x = shift[replicate][k];
+			for (int j = 0; n >> j; j++)
+				if ((n >> j) & 1) x ^= direction[k][j];
+			u[k] = (x + 0.5) / 4294967296.0;
+		}
+		break;
+	case haltonSampling:
+		for (int k = 0; k < dimensions; k++)
+		{
+			const int p = primes[k];
+			double inverse = 0.0, scale = 1.0 / p;
+			for (long long m = n + 1; m; m /= p, scale /= p) inverse += (m % p) * scale;
+			inverse += offset[replicate][k];
+			u[k] = inverse < 1.0 ? inverse : inverse - 1.0;
+		}
+		break;
+	}
+}
+
+// The integrand at one point: expressions read all coordinates, the other
+// integrands become the separable product f(x1) f(x2) ... f(xd)
+static double pointValue(const Integrand& f, const double* x, int dimensions)
+{
+	if (f.name == "expr") return ExpressionFunctor::evaluate(f.expression, x);
+	double y = 1.0;
+	for (int k = 0; k < dimensions; k++) y *= f.value(f, x[k]);
+	return y;
+}
+
+// Monte Carlo over [x1, x2]^d in rounds that double the points of each of
+// the qmcReplicates streams, until the standard error reaches target or
+// maxSamples is spent. Each round's chunks are summed in parallel and stored
+// by index, then added in a fixed order, so the estimate does not depend on
+// the thread count. The pseudo-random standard error comes from the sample
+// variance of all points; the quasi-random one from the spread of the
+// replicate means, as the points of one sequence are not independent.
+const Result monteCarloMethod(const double x1, const double x2, const double target, const int nThreads,
+                              const Integrand& f, Sampling sampling, const Options& options)
+{
+	const int d = options.dimensions;
+	if (f.expression.dimensions > d)
+		throw invalid_argument("The integrand uses x" + to_string(f.expression.dimensions) + "; raise --dimensions");
+
+	double now = omp_get_wtime();
+	const PointSet points(sampling, d, options.seed);
+	const double width = x2 - x1, volume = pow(width, d);
+	const bool quasiRandom = sampling != pseudoRandomSampling;
+	long long limit = max(options.maxSamples / qmcReplicates, 1LL);
+	if (sampling == sobolSampling) limit = min(limit, 1LL << 32);  // 32-bit direction numbers
+
+	double sums[qmcReplicates] = {}, squares[qmcReplicates] = {};
+	long long done = 0;
+	double area = 0.0, error = numeric_limits<double>::infinity(), chunkTime = 0.0;
+	const bool nested = omp_get_level() > 0;
+
+	while (done < limit && !(error <= target))
+	{
+		const long long end = min(max(2 * done, 1024LL), limit);
+		const long long perReplicate = (end - done + monteCarloChunk - 1) / monteCarloChunk;
+		const long long chunks = perReplicate * qmcReplicates;
+		vector<double> chunkSums(chunks), chunkSquares(chunks);
+
+		// The cost model sizes each round's team from the time per chunk of the
+		// round before; the first round runs on this thread. In job mode the
+		// round runs inside its job's task.
+		int team = nested ? 1 : nThreads;
+		if (costModel.enabled && !nested) team = chunkTime > 0 ? costModel.threadsFor(chunks, chunkTime, nThreads) : 1;
+		if (!nested) costModel.useTeam(team);
+		const double roundStart = omp_get_wtime();
+
+		tracer.begin("monte carlo round", team);
+		#pragma omp parallel for schedule(runtime) num_threads(team) if(team > 1)
+		for (long long chunk = 0; chunk < chunks; chunk++)
+		{
+			TracedIteration traced;
+			const int replicate = static_cast<int>(chunk / perReplicate);
+			const long long begin = done + chunk % perReplicate * monteCarloChunk;
+			const long long stop = min(begin + monteCarloChunk, end);
+			double u[maxDimensions], x[maxDimensions], s = 0.0, s2 = 0.0;
+			for (long long n = begin; n < stop; n++)
+			{
+				points.point(n, replicate, u);
+				for (int k = 0; k < d; k++) x[k] = x1 + width * u[k];
+				const double y = pointValue(f, x, d);
+				s += y;
+				s2 += y * y;
+			}
+			chunkSums[chunk] = s;
+			chunkSquares[chunk] = s2;
+		}
+		tracer.end();
+		chunkTime = (omp_get_wtime() - roundStart) * team / chunks;
+
+		for (int r = 0; r < qmcReplicates; r++)
+		{
+			sums[r] += pairwiseSum(chunkSums.data() + r * perReplicate, perReplicate);
+			squares[r] += pairwiseSum(chunkSquares.data() + r * perReplicate, perReplicate);
+		}
+		done = end;
+
+		const double samples = static_cast<double>(done) * qmcReplicates;
+		double total = 0.0, totalSquares = 0.0;
+		for (int r = 0; r < qmcReplicates; r++)
+		{
+			total += sums[r];
+			totalSquares += squares[r];
+		}
+		const double mean = total / samples;
+		double variance;
+		if (quasiRandom)
+		{
+			double spread = 0.0;
+			for (int r = 0; r < qmcReplicates; r++) spread += (sums[r] / done - mean) * (sums[r] / done - mean);
+			variance = spread / (qmcReplicates * (qmcReplicates - 1));
+		}
+		else variance = max(totalSquares / samples - mean * mean, 0.0) / (samples - 1);
+		area = volume * mean;
+		error = volume * sqrt(variance);
+
+		if (options.progress)
+			cerr << "samples: " << static_cast<long long>(samples) << ", area: " << setprecision(17) << area
+			     << ", standard error: " << error << endl;
+	}
+
+	return { omp_get_wtime() - now, area, done * qmcReplicates, error, error <= target ? 0 : 1 };
+}
+
+// Reads one job per line, "x1 x2 dx method [integrand]" (blank lines and
+// lines starting with # are skipped), until the stream ends or count jobs
+// have been read (count < 0: no limit). One thread of a single team reads the
+// stream and spawns every job as a task; large jobs split further into tasks
+// (see taskedSum), so the team stays busy across many small and few large jobs
+// without any fork per job. sink(job, result, error) is called inside
+// critical(jobOutput) as soon as each job finishes, with an empty error on
+// success. Returns the number of jobs read.
+template <typename Sink>
+long long streamJobs(istream& in, const long long count, const int nThreads, const Options& options, Sink sink)
+{
+	long long jobs = 0;
+
+	#pragma omp parallel num_threads(nThreads)
+	#pragma omp single
+	{
+		string line;
+		while ((count < 0 || jobs < count) && getline(in, line))
+		{
+			const size_t start = line.find_first_not_of(" \t\r");
+			if (start == string::npos || line[start] == '#') continue;
+
+			Job job = { jobs++, 0.0, 0.0, 0.0, 0, options };
+			istringstream fields(line);
+			string integrand;
+			fields >> job.x1 >> job.x2 >> job.dx >> job.method;
+			const bool valid = fields && job.method >= 1 && job.method <= 12 && job.dx > 0 &&
+			                   (!(fields >> integrand) || parseIntegrand(integrand.c_str(), job.options.integrand));
+			if (!valid)
+			{
+				#pragma omp critical(jobOutput)
+				sink(job, Result(), "invalid line: " + line);
+				continue;
+			}
+
+			#pragma omp task firstprivate(job)
+			{
+				Result result = Result();
+				string error;
+				try
+				{
+					result = runMethod(job.method, job.x1, job.x2, job.dx, nThreads, job.options);
+				}
+				catch (exception& e)
+				{
+					error = e.what();
+				}
+				#pragma omp critical(jobOutput)
+				sink(job, result, error);
+			}
+		}
+	}
+	return jobs;
+}
+
+// --jobs: run the stream at path (stdin for "-") and write each result in
+// completion order, tagged with the job's index
+int runJobs(const char* path, const int nThreads, const Options& options)
+{
+	if (options.device >= 0)
+	{
+		cerr << "Error: --device runs in batch mode only" << endl;
+		return 1;
+	}
+	ifstream file;
+	if (strcmp(path, "-") != 0)
+	{
+		file.open(path);
+		if (!file)
+		{
+			cerr << "Error: cannot open job file " << path << endl;
+			return 1;
+		}
+	}
+	istream& in = strcmp(path, "-") == 0 ? cin : file;
+
+	long long failed = 0;
+	bool header = true;
+	double now = omp_get_wtime();
+
+	const long long jobs = streamJobs(in, -1, nThreads, options,
+		[&](const Job& job, const Result& result, const string& error)
+		{
+			if (!error.empty())
+			{
+				cerr << "Error: job " << job.index << ": " << error << endl;
+				failed++;
+				return;
+			}
+			const vector<ReportField> report = {
+				field("job", job.index), field("method", static_cast<int>(job.method)),
+				field("x1", job.x1), field("x2", job.x2), field("dx", job.dx),
+				field("integrand", job.options.integrand.name), field("time", result.timestamp),
+				field("area", result.area), field("evaluations", result.evaluations),
+				field("error_estimate", result.error), field("unconverged", result.unconverged)
+			};
+			printReport(cout, report, options.format, header);
+			header = false;
+		});
+
+	cerr << "Jobs: " << jobs << ", failed: " << failed << ", threads: " << nThreads
+	     << ", wall time: " << omp_get_wtime() - now << " s" << endl;
+	return failed ? 1 : 0;
+}
+
+// Server mode: a long-running process that keeps the OpenMP team, the
+// Gauss-Legendre rule and the fork/join calibration warm across requests.
+// Clients connect to the Unix socket at path, one at a time, and send:
+//   integrate <x1> <x2> <dx> <method> <threads> [integrand]
+//                              reply "ok <area> <time> <evaluations>
+//                              <error_estimate> <unconverged>"
+//   jobs <count> <threads>     followed by count lines in the --jobs format,
+//                              run as tasks on one team; one reply
+//                              "result <job> <area> <time> <evaluations>
+//                              <error_estimate> <unconverged>" or
+//                              "failed <job> <message>" per job in completion
+//                              order, then "ok <jobs> <failed> <seconds>"
+//   quit | shutdown            close this connection | stop the server (as
+//                              SIGINT and SIGTERM do)
+// Results are a handful of scalars, so they travel inline on the socket.
+// Errors reply "error <message>". The other options (schedule, reduction,
+// cost model, ...) come from the command line.
+int serve(const char* path, const Options& options)
+{
+	if (options.device >= 0)
+	{
+		cerr << "Error: --device runs in batch mode only" << endl;
+		return 1;
+	}
+	const int listener = listenOn(path);
+	if (listener < 0) return 1;
+
+	bool running = true;
+	while (running && !stopServing)
+	{
+		Connection client = { accept(listener, nullptr, nullptr), string() };
+		if (client.fd < 0) continue;
+
+		string line;
+		while (client.readLine(line))
+		{
+			istringstream request(line);
+			string command;
+			request >> command;
+			ostringstream reply;
+			reply << setprecision(17);
+			try
+			{
+				if (command == "quit") break;
+				if (command == "shutdown")
+				{
+					running = false;
+					client.writeLine("ok");
+					break;
+				}
+
+				if (command == "integrate")
+				{
+					double x1, x2, dx;
+					int method = 0, threads = 0;
+					string integrand;
+					Options job = options;
+					if (!(request >> x1 >> x2 >> dx >> method >> threads) || threads <= 0)
+						throw invalid_argument("usage: integrate <x1> <x2> <dx> <method> <threads> [integrand]");
+					if (request >> integrand && !parseIntegrand(integrand.c_str(), job.integrand))
+						throw invalid_argument("invalid integrand " + integrand);
+					if (job.costModel) costModel.calibrate(threads, job.calibrationFile, job.recalibrate);
+					const Result result = runMethod(method, x1, x2, dx, threads, job);
+					reply << "ok " << result.area << ' ' << result.timestamp << ' ' << result.evaluations << ' '
+					      << result.error << ' ' << result.unconverged;
+				}
+				else if (command == "jobs")
+				{
+					long long count = 0;
+					int threads = 0;
+					if (!(request >> count >> threads) || count < 0 || threads <= 0)
+						throw invalid_argument("usage: jobs <count> <threads>");
+					string batch;
+					for (long long i = 0; i < count && client.readLine(line); i++) batch += line + "\n";
+
+					istringstream in(batch);
+					long long failed = 0;
+					const double now = omp_get_wtime();
+					const long long jobs = streamJobs(in, count, threads, options,
+						[&](const Job& job, const Result& result, const string& error)
+						{
+							ostringstream text;
+							if (!error.empty())
+							{
+								text << "failed " << job.index << ' ' << error;
+								failed++;
+							}
+							else
+								text << "result " << job.index << ' ' << setprecision(17) << result.area << ' '
+								     << result.timestamp << ' ' << result.evaluations << ' ' << result.error
+								     << ' ' << result.unconverged;
+							client.writeLine(text.str());
+						});
+					reply << "ok " << jobs << ' ' << failed << ' ' << omp_get_wtime() - now;
+				}
+				else throw invalid_argument("unknown command " + command);
+			}
+			catch (exception& e)
+			{
+				reply.str("");
+				reply << "error " << e.what();
+			}
+			client.writeLine(reply.str());
+		}
+		close(client.fd);
+	}
+
+	if (stopServing) cerr << "Stopped by signal" << endl;
+	close(listener);
+	unlink(path);
+	return 0;
 }